@@ -0,0 +1,416 @@
+// Benchmarks of the rules and rendering paths.
+//
+// Command line: --json (one JSON object per case instead of a table),
+// --case NAME (run only the cases whose name starts with NAME),
+// --seconds S (minimum time per case, 0.5 by default),
+// --no-render (skip the cases that need an OpenGL context),
+// --check-allocs (only play moves the way the game does and fail on the
+// first one that allocates, for a quick regression check).
+//
+// Render cases draw into an offscreen sf::RenderTexture. On Linux they need
+// an X display, a software one is enough: xvfb-run ./bench. Without DISPLAY
+// they are skipped.
+#include "engine.h"
+#include "gems.h"
+#include "profiler.h"
+#include "snapshot.h"
+#include "timeline.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+// Every allocation of the process goes through here and is counted
+static std::atomic<long> allocations(0);
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+struct Options {
+    bool json = false;
+    bool render = true;
+    bool checkAllocs = false;
+    double seconds = 0.5;
+    const char* only = nullptr;
+};
+
+struct Result {
+    std::string name;
+    long ops; // operations timed
+    double seconds;
+    long moves; // swaps played among them
+    long allocations;
+};
+
+static volatile long sink; // keeps results of pure functions alive
+
+// Run op in growing batches until opts.seconds have passed. Op does one
+// operation and returns the number of moves it made.
+template <class F>
+static Result measure(const char* name, const Options& opts, F op)
+{
+    op(); // warm up
+    Result result = { name, 0, 0, 0, 0 };
+    long allocated = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (long batch = 1; result.seconds < opts.seconds; batch *= 2) {
+        for (long i = 0; i < batch; i++) {
+            result.moves += op();
+        }
+        result.ops += batch;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    result.allocations = allocations.load() - allocated;
+    return result;
+}
+
+static void report(const Result& r, const Options& opts)
+{
+    double nsPerOp = r.seconds * 1e9 / r.ops;
+    double allocsPerOp = double(r.allocations) / r.ops;
+    if (opts.json) {
+        printf("{\"case\":\"%s\",\"ops\":%ld,\"ns_per_op\":%.1f,\"allocs_per_op\":%.3f", r.name.c_str(), r.ops, nsPerOp, allocsPerOp);
+        if (r.moves > 0) {
+            printf(",\"moves_per_sec\":%.0f,\"allocs_per_move\":%.3f", r.moves / r.seconds, double(r.allocations) / r.moves);
+        }
+        printf("}\n");
+    }
+    else {
+        printf("%-22s %12.1f ns/op %14.0f moves/s %10.3f allocs/op\n", r.name.c_str(), nsPerOp, r.moves / r.seconds, allocsPerOp);
+    }
+    fflush(stdout);
+}
+
+static bool selected(const char* name, const Options& opts)
+{
+    return opts.only == nullptr || strncmp(name, opts.only, strlen(opts.only)) == 0;
+}
+
+// Play the first move the engine finds, a full cascade every time
+template <class Engine>
+static int playHint(Engine& engine, StepLog* steps)
+{
+    Move move;
+    if (!engine.hint(move)) {
+        return 0;
+    }
+    return engine.swap(move.x1, move.y1, move.x2, move.y2, steps) ? 1 : 0;
+}
+
+template <class Engine>
+static void benchCascade(const char* name, const Engine& start, const Options& opts)
+{
+    if (!selected(name, opts)) {
+        return;
+    }
+    Engine engine = start;
+    report(measure(name, opts, [&]() { return playHint(engine, nullptr); }), opts);
+}
+
+// The gravity the processor gets must match the shift fallback on random
+// boards with any number of holes, full columns of holes included
+template <int W, int H>
+static bool checkGravity(int boards)
+{
+    Rng rng(W * H);
+    for (int i = 0; i < boards; i++) {
+        BitBoard<W, H> fast(5);
+        fast.refill([&]() { return rng.below(5); });
+        int holes = rng.below(W * H + 1);
+        for (int hole = 0; hole < holes; hole++) {
+            int x = rng.below(W);
+            int y = rng.below(H);
+            fast.setColor(x, y, -1);
+        }
+        BitBoard<W, H> slow = fast;
+        fast.gravity();
+        slow.fallByShifts();
+        for (int c = 0; c < 5; c++) {
+            if (fast.color[c] != slow.color[c]) {
+                fprintf(stderr, "gravity differs from the shift fallback on a %dx%d board\n", W, H);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Moves played the way the game plays them, every step recorded and shown
+// by a timeline with the room GameBoard gives them, must not allocate.
+// Boards larger than a BoardView are played without steps.
+template <class Engine>
+static bool checkAllocations(const char* name, Engine engine, int moves)
+{
+    const size_t RESERVED_STEPS = 64;
+    bool record = engine.getWidth() <= BoardView::WIDTH && engine.getHeight() <= BoardView::HEIGHT;
+    StepLog steps;
+    Timeline timeline;
+    steps.reserve(RESERVED_STEPS, engine.getWidth() * engine.getHeight());
+    timeline.reserve(RESERVED_STEPS, engine.getWidth() * engine.getHeight());
+    for (int i = 0; i < moves; i++) {
+        Move move;
+        if (!engine.hint(move)) {
+            fprintf(stderr, "%s: no move left after %d moves\n", name, i);
+            return false;
+        }
+        long before = allocations.load();
+        steps.clear();
+        engine.swap(move.x1, move.y1, move.x2, move.y2, record ? &steps : nullptr);
+        for (const Step& step : steps) {
+            timeline.push(step, 1);
+        }
+        while (timeline.isBusy()) {
+            timeline.advance(1);
+        }
+        long allocated = allocations.load() - before;
+        if (allocated != 0) {
+            fprintf(stderr, "%s: move %d allocated %ld times\n", name, i, allocated);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void benchRules(const Options& opts)
+{
+    const int BOARDS = 64;
+    typedef BitBoard<8, 8> Board;
+
+    if (selected("checkCombo", opts)) {
+        std::vector<GameEngine> engines;
+        for (int i = 0; i < BOARDS; i++) {
+            engines.push_back(GameEngine(Rng(i)));
+        }
+        int next = 0;
+        report(measure("checkCombo", opts, [&]() {
+            sink = sink + engines[next++ % BOARDS].checkCombo();
+            return 0;
+        }), opts);
+    }
+
+    benchCascade("cascade", GameEngine(Rng(1)), opts);
+    benchCascade("cascade/flat8x8", FlatEngine(FlatBoard(8, 8, 5), Rng(1)), opts);
+    benchCascade("cascade/flat64x64", FlatEngine(FlatBoard(64, 64, 5), Rng(1)), opts);
+
+    if (selected("cascade/steps", opts)) {
+        // The way the game plays a move: every stage recorded for the animation
+        GameEngine engine(Rng(1));
+        StepLog steps;
+        report(measure("cascade/steps", opts, [&]() {
+            steps.clear();
+            return playHint(engine, &steps);
+        }), opts);
+    }
+
+    // Boards with a few random holes, and the same boards after the fall
+    Rng rng(7);
+    std::vector<Board> holed(BOARDS);
+    std::vector<Board> fallen(BOARDS);
+    for (int i = 0; i < BOARDS; i++) {
+        holed[i].refill([&]() { return rng.below(5); });
+        for (int hole = 0; hole < 6; hole++) {
+            int x = rng.below(8);
+            int y = rng.below(8);
+            holed[i].setColor(x, y, -1);
+        }
+        fallen[i] = holed[i];
+        fallen[i].gravity();
+    }
+
+    if (selected("gravity", opts)) {
+        int next = 0;
+        report(measure("gravity", opts, [&]() {
+            Board board = holed[next++ % BOARDS];
+            board.gravity();
+            sink = sink + long(board.color[0]);
+            return 0;
+        }), opts);
+    }
+
+    if (selected("gravity/shifts", opts)) {
+        // The fallback used when the processor has no fast BMI2
+        int next = 0;
+        report(measure("gravity/shifts", opts, [&]() {
+            Board board = holed[next++ % BOARDS];
+            board.fallByShifts();
+            sink = sink + long(board.color[0]);
+            return 0;
+        }), opts);
+    }
+
+    if (selected("refill", opts)) {
+        int next = 0;
+        report(measure("refill", opts, [&]() {
+            Board board = fallen[next++ % BOARDS];
+            board.refill([&]() { return rng.below(5); });
+            sink = sink + long(board.color[0]);
+            return 0;
+        }), opts);
+    }
+
+    if (selected("newBoard", opts)) {
+        // A new engine is one pass over the cells and the move check
+        uint64_t seed = 0;
+        report(measure("newBoard", opts, [&]() {
+            GameEngine engine{ Rng(seed++) };
+            sink = sink + engine.getColor(0, 0);
+            return 0;
+        }), opts);
+    }
+
+    if (selected("timer", opts)) {
+        // A scope timer as the rules pay for it, with the profiler off and on
+        report(measure("timer/off", opts, [&]() {
+            ScopedTimer timer(Phase::BONUS);
+            return 0;
+        }), opts);
+        Profiler::instance().setEnabled(true);
+        report(measure("timer/on", opts, [&]() {
+            ScopedTimer timer(Phase::BONUS);
+            return 0;
+        }), opts);
+        Profiler::instance().setEnabled(false);
+    }
+
+    if (selected("snapshot/load", opts)) {
+        // Resuming a saved game, records of a mapped file are used the same way
+        std::vector<Snapshot> saved(BOARDS);
+        for (int i = 0; i < BOARDS; i++) {
+            GameEngine engine{ Rng(i) };
+            playHint(engine, nullptr);
+            saveSnapshot(engine, saved[i]);
+        }
+        GameEngine engine{ Rng(0) };
+        int next = 0;
+        report(measure("snapshot/load", opts, [&]() {
+            sink = sink + loadSnapshot(engine, saved[next++ % BOARDS]);
+            return 0;
+        }), opts);
+    }
+}
+
+static void benchRender(const Options& opts)
+{
+    if (!selected("render", opts)) {
+        return;
+    }
+#if defined(__linux__)
+    if (getenv("DISPLAY") == nullptr) {
+        fprintf(stderr, "render cases skipped: no DISPLAY\n");
+        return;
+    }
+#endif
+    sf::RenderTexture texture;
+    if (!texture.create(801, 900)) {
+        fprintf(stderr, "render cases skipped: no OpenGL context\n");
+        return;
+    }
+    const float FRAME = 1.0f / 60;
+    GameBoard game;
+
+    if (selected("render/idle", opts)) {
+        report(measure("render/idle", opts, [&]() {
+            game.update(FRAME);
+            texture.clear(sf::Color::Black);
+            game.render(texture);
+            texture.display();
+            return 0;
+        }), opts);
+    }
+
+    if (selected("render/animated", opts)) {
+        // Swap a random pair whenever the last move has been shown
+        Rng rng(3);
+        report(measure("render/animated", opts, [&]() {
+            int moved = 0;
+            if (!game.isAnimating()) {
+                int x = rng.below(7);
+                int y = rng.below(8);
+                game.touchCell(x, y);
+                game.touchCell(x + 1, y);
+                moved = 1;
+            }
+            game.update(FRAME);
+            texture.clear(sf::Color::Black);
+            game.render(texture);
+            texture.display();
+            return moved;
+        }), opts);
+    }
+
+    if (selected("render/firstFrame", opts)) {
+        // A new board up to its first frame; the glyph atlas is already made
+        report(measure("render/firstFrame", opts, [&]() {
+            GameBoard board;
+            texture.clear(sf::Color::Black);
+            board.render(texture);
+            texture.display();
+            return 0;
+        }), opts);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options opts;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            opts.json = true;
+        }
+        else if (strcmp(argv[i], "--no-render") == 0) {
+            opts.render = false;
+        }
+        else if (strcmp(argv[i], "--check-allocs") == 0) {
+            opts.checkAllocs = true;
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            opts.seconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--case") == 0 && i + 1 < argc) {
+            opts.only = argv[++i];
+        }
+    }
+
+    if (!opts.json) {
+        printf("gravity: %s\n", bits::hasBmi2() ? "bmi2" : "shifts");
+    }
+    if (!checkGravity<8, 8>(10000) || !checkGravity<7, 7>(10000) || !checkGravity<6, 6>(10000)) {
+        return 1;
+    }
+    if (opts.checkAllocs) {
+        const int MOVES = 20000;
+        bool clean = checkAllocations("8x8", GameEngine(Rng(1)), MOVES)
+            && checkAllocations("7x7", SmallEngine(Rng(2)), MOVES)
+            && checkAllocations("6x6", TinyEngine(Rng(3)), MOVES)
+            && checkAllocations("flat 8x8", FlatEngine(FlatBoard(8, 8, 5), Rng(4)), MOVES)
+            && checkAllocations("flat 64x64", FlatEngine(FlatBoard(64, 64, 5), Rng(5)), MOVES / 10);
+        if (clean) {
+            printf("no allocations in any move\n");
+        }
+        return clean ? 0 : 1;
+    }
+    benchRules(opts);
+    if (opts.render) {
+        benchRender(opts);
+    }
+}
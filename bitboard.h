@@ -0,0 +1,509 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "board.h"
+
+// BMI2 bit gather and scatter, only used when the processor has them fast
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define BITS_BMI2 1
+#define BITS_TARGET_BMI2 __attribute__((target("bmi2")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define BITS_BMI2 1
+#define BITS_TARGET_BMI2
+#endif
+
+namespace bits {
+
+// Index of the lowest set bit, mask must not be zero
+inline int lowest(uint64_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return int(index);
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+inline int count(uint64_t mask)
+{
+#ifdef _MSC_VER
+    return int(__popcnt64(mask));
+#else
+    return __builtin_popcountll(mask);
+#endif
+}
+
+#ifdef BITS_BMI2
+// eax, ebx, ecx, edx of a cpuid leaf, subleaf 0
+inline void cpuid(unsigned info[4], unsigned leaf)
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuidex(regs, int(leaf), 0);
+    for (int i = 0; i < 4; i++) {
+        info[i] = unsigned(regs[i]);
+    }
+#else
+    __cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+#endif
+}
+
+// PEXT and PDEP that are worth using. AMD processors before Zen 3 (family
+// 19h), and the Hygon ones built on Zen 1, report BMI2 but run these two
+// in microcode at about 250 cycles each, far slower than the shifts.
+inline bool detectBmi2()
+{
+    unsigned info[4];
+    cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    // The vendor string is in ebx, edx, ecx
+    bool amd = (info[1] == 0x68747541 && info[3] == 0x69746e65 && info[2] == 0x444d4163) // "AuthenticAMD"
+        || (info[1] == 0x6f677948 && info[3] == 0x6e65476e && info[2] == 0x656e6975); // "HygonGenuine"
+    cpuid(info, 1);
+    unsigned family = (info[0] >> 8) & 0x0f;
+    if (family == 0x0f) {
+        family += (info[0] >> 20) & 0xff;
+    }
+    if (amd && family < 0x19) {
+        return false;
+    }
+    cpuid(info, 7);
+    return (info[1] & (1 << 8)) != 0;
+}
+
+// Checked once per process
+inline bool hasBmi2()
+{
+    static const bool supported = detectBmi2();
+    return supported;
+}
+#else
+inline bool hasBmi2() { return false; }
+#endif
+
+// Cells of column x on a board with rows of w cells
+constexpr uint64_t column(int w, int h, int x)
+{
+    uint64_t mask = 0;
+    for (int y = 0; y < h; y++) {
+        mask |= 1ull << (y * w + x);
+    }
+    return mask;
+}
+
+// Cells with at least n more cells to their right in the same row
+constexpr uint64_t leftOf(int w, int h, int n)
+{
+    uint64_t mask = 0;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x + n < w; x++) {
+            mask |= 1ull << (y * w + x);
+        }
+    }
+    return mask;
+}
+
+}
+
+// Board of at most 64 cells kept as one 64-bit mask per color. Cell (x, y)
+// is bit y * W + x, so moving one cell right is a shift by 1 and one cell
+// down a shift by W. The size is a template parameter so that all masks
+// are compile-time constants.
+template <int W = 8, int H = 8>
+struct BitBoard {
+    static_assert(W >= 1 && H >= 1 && W * H <= 64, "a bitboard holds at most 64 cells");
+
+    static const int WIDTH = W;
+    static const int HEIGHT = H;
+    static const int MAX_COLORS = 8;
+    static constexpr uint64_t ALL = W * H == 64 ? ~0ull : (1ull << (W * H)) - 1;
+    static constexpr uint64_t FIRST_ROW = W == 64 ? ~0ull : (1ull << W) - 1;
+    static constexpr uint64_t FIRST_COLUMN = bits::column(W, H, 0);
+    static constexpr uint64_t LAST_COLUMN = bits::column(W, H, W - 1);
+    // cells where a horizontal triple can start (x <= W - 3)
+    static constexpr uint64_t TRIPLE_START = bits::leftOf(W, H, 2);
+
+    uint64_t color[MAX_COLORS]; // cells of each color
+    uint64_t bomb; // cells holding a bomb
+    uint64_t brush[MAX_COLORS]; // cells holding a brush of each color
+    int colorCount; // colors in play
+    uint64_t changed; // cells whose neighbourhood has to be checked
+    uint64_t matchedRows; // cells of horizontal runs found by collectMatches
+    uint64_t matchedColumns; // cells of vertical runs
+
+    // Zobrist hash of the masks as hash() last saw them. Only the cells
+    // that differ from them are rehashed, so the moves themselves pay
+    // nothing for it. Not safe to call on a board shared between threads.
+    mutable uint64_t key;
+    mutable uint64_t hashedColor[MAX_COLORS];
+    mutable uint64_t hashedBomb;
+    mutable uint64_t hashedBrush[MAX_COLORS];
+
+    explicit BitBoard(int colors = 5)
+        : bomb(0)
+        , colorCount(colors)
+        , changed(0)
+        , matchedRows(0)
+        , matchedColumns(0)
+        , key(0)
+        , hashedBomb(0)
+    {
+        assert(colors >= 3 && colors <= MAX_COLORS);
+        for (int c = 0; c < MAX_COLORS; c++) {
+            color[c] = 0;
+            brush[c] = 0;
+            hashedColor[c] = 0;
+            hashedBrush[c] = 0;
+        }
+    }
+
+    int width() const { return W; }
+    int height() const { return H; }
+    int colors() const { return colorCount; }
+
+    uint64_t hash() const
+    {
+        for (int c = 0; c < colorCount; c++) {
+            rehash(hashedColor[c], color[c], c);
+            rehash(hashedBrush[c], brush[c], zobrist::BRUSH + c);
+        }
+        rehash(hashedBomb, bomb, zobrist::BOMB);
+        return key;
+    }
+
+    // Toggle the keys of the feature in the cells where seen and now differ
+    void rehash(uint64_t& seen, uint64_t now, int feature) const
+    {
+        for (uint64_t diff = seen ^ now; diff; diff &= diff - 1) {
+            key ^= zobrist::key(bits::lowest(diff), feature);
+        }
+        seen = now;
+    }
+
+    static uint64_t bit(int x, int y) { return 1ull << (y * W + x); }
+
+    // Masks moved by one cell, cells pushed over an edge are dropped
+    static uint64_t east(uint64_t m) { return (m << 1) & ~FIRST_COLUMN & ALL; }
+    static uint64_t west(uint64_t m) { return (m >> 1) & ~LAST_COLUMN; }
+    static uint64_t south(uint64_t m) { return (m << W) & ALL; }
+    static uint64_t north(uint64_t m) { return m >> W; }
+
+    // Cells that hold a gem of any color
+    uint64_t filled() const
+    {
+        uint64_t mask = 0;
+        for (int c = 0; c < colorCount; c++) {
+            mask |= color[c];
+        }
+        return mask;
+    }
+
+    // Cells holding a bomb or a brush
+    uint64_t bonuses() const
+    {
+        uint64_t mask = bomb;
+        for (int c = 0; c < colorCount; c++) {
+            mask |= brush[c];
+        }
+        return mask;
+    }
+
+    int colorAt(int x, int y) const
+    {
+        uint64_t b = bit(x, y);
+        for (int c = 0; c < colorCount; c++) {
+            if (color[c] & b) {
+                return c;
+            }
+        }
+        return -1;
+    }
+
+    // Put color c into the cell, -1 empties it
+    void setColor(int x, int y, int c)
+    {
+        uint64_t b = bit(x, y);
+        for (int i = 0; i < colorCount; i++) {
+            color[i] &= ~b;
+        }
+        if (c >= 0) {
+            color[c] |= b;
+        }
+    }
+
+    Bonus bonusAt(int x, int y) const
+    {
+        if (bomb & bit(x, y)) {
+            return Bonus::BOMB;
+        }
+        return brushAt(x, y) >= 0 ? Bonus::BRUSH : Bonus::NONE;
+    }
+
+    int brushAt(int x, int y) const
+    {
+        uint64_t b = bit(x, y);
+        for (int c = 0; c < colorCount; c++) {
+            if (brush[c] & b) {
+                return c;
+            }
+        }
+        return -1;
+    }
+
+    // Brush is the color of a BRUSH bonus and ignored otherwise
+    void setBonus(int x, int y, Bonus bonus, int brushColor)
+    {
+        uint64_t b = bit(x, y);
+        bomb &= ~b;
+        for (int c = 0; c < colorCount; c++) {
+            brush[c] &= ~b;
+        }
+        if (bonus == Bonus::BOMB) {
+            bomb |= b;
+        }
+        else if (bonus == Bonus::BRUSH) {
+            brush[brushColor] |= b;
+        }
+    }
+
+    void swapCells(int x1, int y1, int x2, int y2)
+    {
+        int a = y1 * W + x1;
+        int b = y2 * W + x2;
+        for (int c = 0; c < colorCount; c++) {
+            uint64_t diff = ((color[c] >> a) ^ (color[c] >> b)) & 1;
+            color[c] ^= (diff << a) | (diff << b);
+        }
+    }
+
+    void markChanged(int x, int y) { changed |= bit(x, y); }
+    void markAll() { changed = ALL; }
+    void resetChanged() { changed = 0; }
+
+    // First cells of horizontal and vertical triples of one color mask
+    static uint64_t rowStarts(uint64_t p) { return p & (p >> 1) & (p >> 2) & TRIPLE_START; }
+    static uint64_t columnStarts(uint64_t p) { return p & (p >> W) & (p >> 2 * W); }
+    static uint64_t rowCells(uint64_t starts) { return starts | (starts << 1) | (starts << 2); }
+    static uint64_t columnCells(uint64_t starts) { return starts | (starts << W) | (starts << 2 * W); }
+
+    bool hasMatch() const
+    {
+        for (int c = 0; c < colorCount; c++) {
+            if (rowStarts(color[c]) | columnStarts(color[c])) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Every cell that is part of a horizontal or vertical three-in-a-row
+    uint64_t matches() const
+    {
+        uint64_t mask = 0;
+        for (int c = 0; c < colorCount; c++) {
+            mask |= rowCells(rowStarts(color[c])) | columnCells(columnStarts(color[c]));
+        }
+        return mask;
+    }
+
+    // Only the colors of the changed cells are looked at, and only the
+    // triples that contain one of them are kept. If the board had no
+    // combination before the change, every new one holds a changed cell.
+    bool hasMatchAround() const
+    {
+        uint64_t nearRow = changed | (changed >> 1) | (changed >> 2);
+        uint64_t nearColumn = changed | north(changed) | north(north(changed));
+        for (int c = 0; c < colorCount; c++) {
+            if ((color[c] & changed) && ((rowStarts(color[c]) & nearRow) | (columnStarts(color[c]) & nearColumn))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int collectMatches()
+    {
+        uint64_t nearRow = changed | (changed >> 1) | (changed >> 2);
+        uint64_t nearColumn = changed | north(changed) | north(north(changed));
+        matchedRows = 0;
+        matchedColumns = 0;
+        for (int c = 0; c < colorCount; c++) {
+            if (color[c] & changed) {
+                matchedRows |= rowCells(rowStarts(color[c]) & nearRow);
+                matchedColumns |= columnCells(columnStarts(color[c]) & nearColumn);
+            }
+        }
+        changed = 0;
+        return bits::count(matchedRows) + bits::count(matchedColumns);
+    }
+
+    template <class F>
+    void forEachMatched(F f) const
+    {
+        for (uint64_t rest = matchedRows | matchedColumns; rest; rest &= rest - 1) {
+            int i = bits::lowest(rest);
+            f(i % W, i / W);
+        }
+    }
+
+    template <class F>
+    void forEachMatchedBonus(F f) const
+    {
+        for (uint64_t rest = (matchedRows | matchedColumns) & bonuses(); rest; rest &= rest - 1) {
+            int i = bits::lowest(rest);
+            f(i % W, i / W);
+        }
+    }
+
+    void clearMatched()
+    {
+        uint64_t mask = matchedRows | matchedColumns;
+        for (int c = 0; c < colorCount; c++) {
+            color[c] &= ~mask;
+        }
+    }
+
+    // Let gems fall into the empty cells below them. Every pass moves all
+    // gems standing on a hole one row down at once, so it takes at most
+    // H - 1 passes. Bonuses belong to cells and stay in place.
+    void gravity()
+    {
+        // everything at or above a hole of the same column can change
+        uint64_t zone = ~filled() & ALL;
+        for (int shift = W; shift < W * H; shift *= 2) {
+            zone |= zone >> shift;
+        }
+        changed |= zone;
+#ifdef BITS_BMI2
+        if (bits::hasBmi2()) {
+            compactColumns(zone & FIRST_ROW);
+            return;
+        }
+#endif
+        fallByShifts();
+    }
+
+    // The two ways gravity moves the gems, public so that they can be
+    // compared with each other. Neither marks changed cells.
+
+    // Every gem above a hole falls one row per pass
+    void fallByShifts()
+    {
+        for (;;) {
+            uint64_t empty = ~filled() & ALL;
+            uint64_t falling = ~empty & north(empty);
+            if (falling == 0) {
+                break;
+            }
+            for (int c = 0; c < colorCount; c++) {
+                uint64_t moved = color[c] & falling;
+                color[c] = (color[c] & ~moved) | south(moved);
+            }
+        }
+    }
+
+#ifdef BITS_BMI2
+    // The gems of each column in columns (bits of the first row) are
+    // gathered top to bottom and scattered into its lowest cells
+    BITS_TARGET_BMI2 void compactColumns(uint64_t columns)
+    {
+        uint64_t full = filled();
+        for (; columns; columns &= columns - 1) {
+            uint64_t cells = FIRST_COLUMN << bits::lowest(columns);
+            uint64_t gems = full & cells;
+            int count = bits::count(gems);
+            uint64_t target = count ? cells & (ALL << ((H - count) * W)) : 0;
+            for (int c = 0; c < colorCount; c++) {
+                color[c] = (color[c] & ~cells) | _pdep_u64(_pext_u64(color[c], gems), target);
+            }
+        }
+    }
+#endif
+
+    // Fill every empty cell in reading order with randomColor()
+    template <class F>
+    void refill(F randomColor)
+    {
+        for (uint64_t rest = ~filled() & ALL; rest; rest &= rest - 1) {
+            color[randomColor()] |= rest & (0 - rest);
+        }
+    }
+
+    // Swaps that produce a combination. A bit in right marks a cell whose
+    // swap with its right neighbour matches, a bit in down one whose swap
+    // with the cell below matches. For every color the cells where that
+    // color would finish a triple are found with shifts, once for each
+    // side the gem can come from, leaving out the patterns that would need
+    // the cell it leaves. Assumes the board has no combination yet.
+    void moves(uint64_t& right, uint64_t& down) const
+    {
+        right = 0;
+        down = 0;
+        for (int c = 0; c < colorCount; c++) {
+            uint64_t p = color[c];
+            uint64_t left2 = east(p) & east(east(p)); // the two cells to the left are c
+            uint64_t right2 = west(p) & west(west(p));
+            uint64_t across = east(p) & west(p); // left and right neighbours are c
+            uint64_t up2 = south(p) & south(south(p));
+            uint64_t down2 = north(p) & north(north(p));
+            uint64_t along = south(p) & north(p); // upper and lower neighbours are c
+            uint64_t vertical = up2 | down2 | along;
+            uint64_t horizontal = left2 | right2 | across;
+
+            right |= p & west(right2 | vertical); // c moves one cell right
+            right |= west(p & east(left2 | vertical)); // c moves one cell left
+            down |= p & north(down2 | horizontal); // c moves one cell down
+            down |= north(p & south(up2 | horizontal)); // c moves one cell up
+        }
+    }
+
+    bool hasMoves() const
+    {
+        uint64_t right, down;
+        moves(right, down);
+        return (right | down) != 0;
+    }
+
+    // The move forEachMove would report first
+    bool firstMove(Move& move) const
+    {
+        uint64_t right, down;
+        moves(right, down);
+        if (right) {
+            int i = bits::lowest(right);
+            move = Move{ i % W, i / W, i % W + 1, i / W };
+            return true;
+        }
+        if (down) {
+            int i = bits::lowest(down);
+            move = Move{ i % W, i / W, i % W, i / W + 1 };
+            return true;
+        }
+        return false;
+    }
+
+    // Horizontal swaps first, then vertical ones, each in reading order
+    template <class F>
+    void forEachMove(F f) const
+    {
+        uint64_t right, down;
+        moves(right, down);
+        for (; right; right &= right - 1) {
+            int i = bits::lowest(right);
+            f(Move{ i % W, i / W, i % W + 1, i / W });
+        }
+        for (; down; down &= down - 1) {
+            int i = bits::lowest(down);
+            f(Move{ i % W, i / W, i % W, i / W + 1 });
+        }
+    }
+};
@@ -0,0 +1,145 @@
+#pragma once
+#include <cstdint>
+
+// Types shared by the board layouts and the rules engine.
+//
+// A board layout stores colors, bonuses and brush colors of a width x height
+// grid and offers the bulk operations the rules are built from:
+//
+//   width(), height(), colors()          size and number of gem colors
+//   colorAt, setColor, bonusAt, brushAt, setBonus, swapCells
+//   markChanged(x, y), markAll()         cells whose neighbourhood must be checked
+//   resetChanged()
+//   hasMatch()                           any three-in-a-row on the whole board
+//   hasMatchAround()                     any three-in-a-row through a changed cell
+//   collectMatches()                     mark all runs through changed cells and
+//                                        return the number of cells in them,
+//                                        counted once per run; consumes the
+//                                        changed cells
+//   forEachMatched(f), forEachMatchedBonus(f)
+//   clearMatched()                       empty the marked cells
+//   gravity()                            let gems fall, marks what moved as changed
+//   refill(randomColor)                  fill the holes in reading order
+//   forEachMove(f), hasMoves()           swaps that produce a combination
+//   firstMove(move)                      the first of them, false if none
+//   hash()                               Zobrist hash of the colors and bonuses
+//                                        the board holds when it is called; a
+//                                        layout may bring a cache up to date
+//                                        inside this const call, so a board is
+//                                        read by one thread at a time
+//
+// Cells are visited in reading order (row by row) everywhere, so two layouts
+// of the same size give the same game from the same random sequence.
+
+enum class Bonus {
+    NONE
+    , BOMB
+    , BRUSH
+};
+
+struct CellPos {
+    int x;
+    int y;
+};
+
+// Swap of two adjacent cells
+struct Move {
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+};
+
+// State of one cell packed into a byte. The low four bits hold the gem
+// color plus one, 0 for a hole, the high four bits the bonus: 0 for none,
+// BOMB for a bomb and BRUSH + c for a brush of color c. A zeroed cell is
+// empty, and boards of cells are copied with a plain memcpy.
+struct Cell {
+    static const uint8_t BOMB = 0x10;
+    static const uint8_t BRUSH = 0x80;
+
+    uint8_t bits = 0;
+
+    int color() const { return (bits & 0x0f) - 1; }
+    Bonus bonus() const { return bits & BRUSH ? Bonus::BRUSH : bits & BOMB ? Bonus::BOMB : Bonus::NONE; }
+    int brush() const { return bits & BRUSH ? (bits >> 4) & 0x07 : -1; }
+
+    // -1 empties the cell
+    void setColor(int c) { bits = uint8_t((bits & 0xf0) | (c + 1)); }
+
+    // Brush is the color of a BRUSH bonus and ignored otherwise
+    void setBonus(Bonus bonus, int brushColor)
+    {
+        uint8_t high = 0;
+        if (bonus == Bonus::BOMB) {
+            high = BOMB;
+        }
+        else if (bonus == Bonus::BRUSH) {
+            high = uint8_t(BRUSH | brushColor << 4);
+        }
+        bits = uint8_t((bits & 0x0f) | high);
+    }
+};
+
+namespace zobrist {
+
+// Features of a cell that are part of the hash
+static const int BOMB = 8; // colors are 0..7
+static const int BRUSH = 9; // BRUSH + c for a brush of color c
+static const int SWAP_RIGHT = 30; // keys of moves, see moveKey
+static const int SWAP_DOWN = 31;
+
+// Random-looking key of a feature of cell y * width + x, the splitmix64
+// finalizer of its index. Computed from the index alone, so boards of any
+// size and layout hash the same contents to the same value.
+constexpr uint64_t mix(uint64_t index)
+{
+    uint64_t z = (index + 1) * 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Keys of the first 64 cells, built at compile time
+struct KeyTable {
+    uint64_t keys[64 << 5];
+    constexpr KeyTable()
+        : keys()
+    {
+        for (int i = 0; i < (64 << 5); i++) {
+            keys[i] = mix(uint64_t(i));
+        }
+    }
+};
+
+template <int Unused = 0>
+struct Keys {
+    static constexpr KeyTable TABLE = KeyTable();
+};
+
+template <int Unused>
+constexpr KeyTable Keys<Unused>::TABLE;
+
+inline uint64_t key(int cell, int feature)
+{
+    int index = cell << 5 | feature;
+    return cell < 64 ? Keys<>::TABLE.keys[index] : mix(uint64_t(index));
+}
+
+// Key of the bonus of a cell, 0 for none
+inline uint64_t bonusKey(int cell, Bonus bonus, int brushColor)
+{
+    if (bonus == Bonus::BOMB) {
+        return key(cell, BOMB);
+    }
+    return bonus == Bonus::BRUSH ? key(cell, BRUSH + brushColor) : 0;
+}
+
+// Key of a swap on a board with rows of width cells, (x1, y1) being the
+// left or upper cell as forEachMove reports it
+inline uint64_t moveKey(const Move& move, int width)
+{
+    return key(move.y1 * width + move.x1, move.y1 == move.y2 ? SWAP_RIGHT : SWAP_DOWN);
+}
+
+}
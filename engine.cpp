@@ -0,0 +1,359 @@
+#include "engine.h"
+#include "profiler.h"
+#include <cassert>
+#include <cstdlib>
+#include <utility>
+
+template <class Board>
+BasicEngine<Board>::BasicEngine()
+    : BasicEngine(Rng(Rng::randomSeed()))
+{
+}
+
+template <class Board>
+BasicEngine<Board>::BasicEngine(const Rng& source)
+    : BasicEngine(Board(), source)
+{
+}
+
+template <class Board>
+BasicEngine<Board>::BasicEngine(const Board& empty, const Rng& source)
+    : board(empty)
+    , score(0)
+    , rng(source)
+    , steps(nullptr)
+    , cascade(0)
+{
+    // initialization: a board without combinations in one pass, and in
+    // the rare case that it has no move either, a second one with a move
+    fillBoard(false);
+    if (!board.hasMoves()) {
+        fillBoard(true);
+    }
+}
+
+template <class Board>
+void BasicEngine<Board>::view(BoardView& out) const
+{
+    assert(board.width() <= BoardView::WIDTH && board.height() <= BoardView::HEIGHT);
+    for (int y = 0; y < BoardView::HEIGHT; y++) {
+        for (int x = 0; x < BoardView::WIDTH; x++) {
+            Cell& cell = out.cells[y][x];
+            cell = Cell();
+            if (x < board.width() && y < board.height()) {
+                cell.setColor(board.colorAt(x, y));
+                cell.setBonus(board.bonusAt(x, y), board.brushAt(x, y));
+            }
+        }
+    }
+}
+
+template <class Board>
+bool BasicEngine<Board>::load(const BoardView& cells, int points, const Rng& source)
+{
+    // The cells are taken as they are, a saved board has no combination left
+    assert(board.width() <= BoardView::WIDTH && board.height() <= BoardView::HEIGHT);
+    for (int y = 0; y < board.height(); y++) {
+        for (int x = 0; x < board.width(); x++) {
+            board.setColor(x, y, cells.color(x, y));
+            board.setBonus(x, y, cells.bonus(x, y), cells.brush(x, y));
+        }
+    }
+    board.resetChanged();
+    score = points;
+    rng = source;
+    cascade = 0;
+    // As after a move, the player is never left without one
+    if (!board.hasMoves()) {
+        reshuffle();
+        return false;
+    }
+    return true;
+}
+
+// The new step, null when the steps are not recorded. Its board is taken
+// now, its cells are added by the caller.
+template <class Board>
+Step* BasicEngine<Board>::emit(StepType type, int scoreDelta, Bonus bonus)
+{
+    if (steps == nullptr) {
+        return nullptr;
+    }
+    Step& step = steps->add();
+    step.type = type;
+    step.cascade = cascade;
+    step.scoreDelta = scoreDelta;
+    step.score = score;
+    step.bonus = bonus;
+    view(step.board);
+    return &step;
+}
+
+template <class Board>
+bool BasicEngine<Board>::swap(int x1, int y1, int x2, int y2, StepLog* out)
+{
+    assert(x1 >= 0 && x1 < board.width() && y1 >= 0 && y1 < board.height());
+    assert(x2 >= 0 && x2 < board.width() && y2 >= 0 && y2 < board.height());
+    if (abs(x1 - x2) + abs(y1 - y2) != 1) {
+        return false;
+    }
+
+    steps = out;
+    cascade = 0;
+    board.swapCells(x1, y1, x2, y2);
+    if (Step* step = emit(StepType::SWAP, 0, Bonus::NONE)) {
+        step->cells.push_back({ x1, y1 });
+        step->cells.push_back({ x2, y2 });
+    }
+
+    // Only the rows and columns through the swapped cells can have a new combination
+    board.markChanged(x1, y1);
+    board.markChanged(x2, y2);
+    bool matched = board.hasMatchAround();
+    if (matched) {
+        gameCore();
+        if (!board.hasMoves()) {
+            reshuffle();
+            emit(StepType::SHUFFLE, 0, Bonus::NONE);
+        }
+    }
+    else {
+        board.resetChanged();
+        board.swapCells(x1, y1, x2, y2);
+    }
+    steps = nullptr;
+    return matched;
+}
+
+template <class Board>
+void BasicEngine<Board>::findMoves(std::vector<Move>& out) const
+{
+    board.forEachMove([&](const Move& move) { out.push_back(move); });
+}
+
+template <class Board>
+bool BasicEngine<Board>::hint(Move& move) const
+{
+    // Stops at the first move instead of listing them all
+    return board.firstMove(move);
+}
+
+template <class Board>
+void BasicEngine<Board>::reshuffle()
+{
+    // Shuffle the gems on the board until they have a move and no combination
+    int width = board.width();
+    int cells = width * board.height();
+    int stackGems[64];
+    static thread_local std::vector<int> heapGems; // grows once per thread, moves stay free of allocations
+    int* gems = stackGems;
+    if (cells > 64) {
+        if (heapGems.size() < size_t(cells)) {
+            heapGems.resize(cells);
+        }
+        gems = heapGems.data();
+    }
+    for (int i = 0; i < cells; i++) {
+        gems[i] = board.colorAt(i % width, i / width);
+    }
+    for (int attempt = 0; attempt < MAX_SHUFFLES; attempt++) {
+        for (int i = cells - 1; i > 0; i--) {
+            int j = rng.below(i + 1);
+            int temp = gems[i];
+            gems[i] = gems[j];
+            gems[j] = temp;
+        }
+        for (int i = 0; i < cells; i++) {
+            board.setColor(i % width, i / width, gems[i]);
+        }
+        if (!board.hasMatch() && board.hasMoves()) {
+            return;
+        }
+    }
+    // Rare: the colors on the board do not allow it, so pick new ones
+    fillBoard(true);
+}
+
+template <class Board>
+void BasicEngine<Board>::fillBoard(bool plantMove)
+{
+    // Every cell is filled in reading order with a color that does not
+    // finish a triple with the cells already placed, so the board has no
+    // combination and costs one random number per cell.
+    // With plantMove "a a b a" goes into the top row first, swapping its
+    // last two cells makes a triple. Boards narrower than 4 cells get the
+    // pattern down the first column.
+    int colors = board.colors();
+    bool across = board.width() >= 4;
+    int planted[4] = { -1, -1, -1, -1 };
+    if (plantMove) {
+        assert(across || board.height() >= 4);
+        int a = rng.below(colors);
+        int b = (a + 1 + rng.below(colors - 1)) % colors;
+        planted[0] = a;
+        planted[1] = a;
+        planted[2] = b;
+        planted[3] = a;
+    }
+    // Colors of the row above and the color of a vertical pair ending
+    // there, per column. The board is only written, never read back.
+    int width = board.width();
+    int stackRows[2 * 64];
+    static thread_local std::vector<int> heapRows; // as in reshuffle
+    int* above = stackRows;
+    if (width > 64) {
+        if (heapRows.size() < size_t(2 * width)) {
+            heapRows.resize(2 * width);
+        }
+        above = heapRows.data();
+    }
+    int* pairs = above + width;
+    for (int y = 0; y < board.height(); y++) {
+        int last = -1; // color of the cell to the left
+        int pair = -1; // color of a pair ending on the left
+        for (int x = 0; x < width; x++) {
+            int along = across ? x : y;
+            int c;
+            if (plantMove && (across ? y : x) == 0 && along < 4) {
+                c = planted[along];
+            }
+            else {
+                // Any color first, so that the cells do not wait for each
+                // other. The few that would finish a triple draw once more
+                // among the allowed colors, skipping the excluded ones.
+                int up = y > 0 ? pairs[x] : -1;
+                c = rng.below(colors);
+                if (c == pair || c == up) {
+                    int first = pair;
+                    int second = up != pair ? up : -1;
+                    if (first < 0 || (second >= 0 && second < first)) {
+                        std::swap(first, second);
+                    }
+                    c = rng.below(colors - (first >= 0) - (second >= 0));
+                    c += first >= 0 && c >= first;
+                    c += second >= 0 && c >= second;
+                }
+            }
+            board.setColor(x, y, c);
+            pair = c == last ? c : -1;
+            last = c;
+            pairs[x] = y > 0 && c == above[x] ? c : -1;
+            above[x] = c;
+        }
+    }
+    board.resetChanged();
+}
+
+template <class Board>
+void BasicEngine<Board>::applyBonus(int x, int y)
+{
+    ScopedTimer timer(Phase::BONUS);
+    switch (board.bonusAt(x, y))
+    {
+    case Bonus::NONE:
+        break;
+    case Bonus::BOMB:
+    {
+        for (size_t i = 0; i < 4; i++) {
+            int bx = rng.below(board.width());
+            int by = rng.below(board.height());
+            board.setColor(bx, by, -1);
+        }
+        score += 50;
+        counts.bombsFired++;
+        board.setBonus(x, y, Bonus::NONE, -1);
+        if (Step* step = emit(StepType::BONUS, 50, Bonus::BOMB)) {
+            step->cells.push_back({ x, y });
+        }
+        break;
+    }
+    case Bonus::BRUSH:
+    {
+        // Repaint one of the two diagonals through the brush
+        int dy = rng.below(2) == 0 ? 1 : -1;
+        int x1 = x - 1;
+        int y1 = y - dy;
+        int x2 = x + 1;
+        int y2 = y + dy;
+        int brush = board.brushAt(x, y);
+        if (x1 < board.width() && x1 >= 0 && y1 < board.height() && y1 >= 0) {
+            board.setColor(x1, y1, brush);
+            board.markChanged(x1, y1);
+        }
+        if (x2 < board.width() && x2 >= 0 && y2 < board.height() && y2 >= 0) {
+            board.setColor(x2, y2, brush);
+            board.markChanged(x2, y2);
+        }
+        counts.brushesFired++;
+        board.setBonus(x, y, Bonus::NONE, -1);
+        if (Step* step = emit(StepType::BONUS, 0, Bonus::BRUSH)) {
+            step->cells.push_back({ x, y });
+        }
+        break;
+    }
+    default:
+        assert(0);
+    }
+}
+
+template <class Board>
+void BasicEngine<Board>::bonusDrop()
+{
+    // odds.dropPercent chance of a new bonus, odds.bombPercent of them bombs
+    int p = rng.below(100);
+    int t = rng.below(100);
+    if (p < odds.dropPercent) {
+        int xc = rng.below(board.width());
+        int yc = rng.below(board.height());
+        if (t < odds.bombPercent) {
+            board.setBonus(xc, yc, Bonus::BOMB, -1);
+            counts.bombsDropped++;
+        }
+        else {
+            board.setBonus(xc, yc, Bonus::BRUSH, rng.below(board.colors()));
+            counts.brushesDropped++;
+        }
+    }
+}
+
+template <class Board>
+void BasicEngine<Board>::gameCore()
+{
+    // Resolve the cascade one step at a time. Each step finds every
+    // horizontal and vertical combination on the board, fires the bonuses
+    // lying on them and removes them together before the cells fall.
+    // Only the cells changed by the previous step are looked at.
+    ScopedTimer timer(Phase::RULES);
+    for (;;) {
+        // 30 points for a triple and 10 for every further cell of a run
+        int points = 10 * board.collectMatches();
+        if (points == 0) {
+            break;
+        }
+        cascade++;
+        score += points;
+
+        board.forEachMatchedBonus([&](int x, int y) { applyBonus(x, y); });
+
+        board.clearMatched();
+        if (Step* step = emit(StepType::CLEAR, points, Bonus::NONE)) {
+            board.forEachMatched([&](int x, int y) { step->cells.push_back({ x, y }); });
+        }
+
+        bonusDrop();
+        board.gravity();
+        refillBoard();
+        emit(StepType::REFILL, 0, Bonus::NONE);
+    }
+}
+
+template <class Board>
+void BasicEngine<Board>::refillBoard() {
+    // Finding empty cells and filling them with new random cells
+    board.refill([&]() { return rng.below(board.colors()); });
+}
+
+template class BasicEngine<BitBoard<6, 6>>;
+template class BasicEngine<BitBoard<7, 7>>;
+template class BasicEngine<BitBoard<8, 8>>;
+template class BasicEngine<FlatBoard>;
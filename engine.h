@@ -0,0 +1,158 @@
+#pragma once
+#include <vector>
+#include "bitboard.h"
+#include "flatboard.h"
+#include "rng.h"
+
+// Copy of the board contents, one byte per cell row by row, so a whole
+// board is a single cache line
+struct BoardView {
+    static const int WIDTH = 8;
+    static const int HEIGHT = 8;
+    Cell cells[HEIGHT][WIDTH];
+
+    int color(int x, int y) const { return cells[y][x].color(); } // -1 for an empty cell
+    Bonus bonus(int x, int y) const { return cells[y][x].bonus(); }
+    int brush(int x, int y) const { return cells[y][x].brush(); } // -1 when there is no brush
+};
+
+enum class StepType {
+    SWAP // two cells were swapped
+    , BONUS // a bonus fired
+    , CLEAR // a combination was removed
+    , REFILL // cells fell down and the holes were refilled
+    , SHUFFLE // no move was left and the board was reshuffled
+};
+
+// One observable stage of a move, in the order it happened
+struct Step {
+    StepType type;
+    int cascade; // index of the cascade step, 0 for the swap itself
+    int scoreDelta; // points earned by this step
+    int score; // total score after the step
+    Bonus bonus; // bonus that fired, for BONUS steps
+    std::vector<CellPos> cells; // swapped, cleared or bonus cells
+    BoardView board; // board after the step
+};
+
+// Steps of the moves swap has recorded. Clearing keeps the steps and their
+// cell lists, so once the log has held a cascade as long as the next one,
+// recording it does not allocate. reserve makes room up front.
+class StepLog {
+public:
+    void reserve(size_t count, size_t cells); // steps of up to cells cells each
+    void clear() { used = 0; }
+    Step& add(); // a new last step with no cells
+
+    size_t size() const { return used; }
+    bool empty() const { return used == 0; }
+    const Step& operator[](size_t i) const { return steps[i]; }
+    const Step& back() const { return steps[used - 1]; }
+    const Step* begin() const { return steps.data(); }
+    const Step* end() const { return steps.data() + used; }
+
+private:
+    std::vector<Step> steps; // the first used ones are recorded, the rest wait for reuse
+    size_t used = 0;
+};
+
+inline void StepLog::reserve(size_t count, size_t cells)
+{
+    if (steps.size() < count) {
+        steps.resize(count);
+    }
+    for (size_t i = 0; i < steps.size(); i++) {
+        steps[i].cells.reserve(cells);
+    }
+}
+
+inline Step& StepLog::add()
+{
+    if (used == steps.size()) {
+        steps.emplace_back();
+    }
+    Step& step = steps[used++];
+    step.cells.clear();
+    return step;
+}
+
+// How often a cleared combination leaves a new bonus behind
+struct BonusOdds {
+    int dropPercent = 10; // chance of a new bonus after each cascade step
+    int bombPercent = 50; // share of bombs among them, the rest are brushes
+};
+
+// Bonuses fired and dropped since the engine was created
+struct BonusCounts {
+    long bombsFired = 0;
+    long brushesFired = 0;
+    long bombsDropped = 0;
+    long brushesDropped = 0;
+};
+
+// Board state and game rules without any window or timing dependency.
+// Board is the layout the cells are kept in, see board.h: BitBoard<W, H>
+// for small boards whose size is known at compile time, FlatBoard for
+// any other size.
+template <class Board>
+class BasicEngine {
+public:
+    static const int MAX_SHUFFLES = 16; // random reshuffles tried before the board is rebuilt
+
+    BasicEngine(); // seeded from the operating system
+    explicit BasicEngine(const Rng& source); // same generator state, same game
+    BasicEngine(const Board& empty, const Rng& source); // board of the size and colors of empty
+
+    // Swap two adjacent cells and resolve the move. A swap that does not
+    // produce a combination is reverted and false is returned.
+    // Every stage is appended to steps when it is not null.
+    bool swap(int x1, int y1, int x2, int y2, StepLog* steps = nullptr);
+    bool checkCombo() const { return board.hasMatch(); }
+
+    // Every swap that produces a combination, without trying them
+    void findMoves(std::vector<Move>& out) const;
+    bool hasMoves() const { return board.hasMoves(); }
+    bool hint(Move& move) const; // one of the moves, false when there is none
+
+    int getWidth() const { return board.width(); }
+    int getHeight() const { return board.height(); }
+    int getColors() const { return board.colors(); }
+    int getColor(int x, int y) const { return board.colorAt(x, y); }
+    Bonus getBonus(int x, int y) const { return board.bonusAt(x, y); }
+    int getBrush(int x, int y) const { return board.brushAt(x, y); }
+    int getScore() const { return score; }
+    uint64_t getHash() const { return board.hash(); } // Zobrist hash of the cells, not of score or generator; may update the board's cache
+    int getCascade() const { return cascade; } // cascade steps of the last move
+    const BonusCounts& getBonusCounts() const { return counts; }
+    const Rng& getRng() const { return rng; }
+    void reseed(uint64_t seed) { rng.reseed(seed); } // a different future for the same board
+    const BonusOdds& getBonusOdds() const { return odds; }
+    void setBonusOdds(const BonusOdds& value) { odds = value; }
+    void view(BoardView& out) const; // boards of at most 8x8 cells only
+    // Continue a saved game, same limit. False when the board had no move
+    // left and was reshuffled, which a saved game never needs.
+    bool load(const BoardView& cells, int points, const Rng& source);
+
+private:
+    Board board; // colors, bombs and brushes of all cells
+    int score; // Points storage box
+    Rng rng; // the only source of randomness of this board
+    StepLog* steps; // receiver of the current move's steps
+    int cascade; // cascade step being resolved
+    BonusOdds odds;
+    BonusCounts counts;
+
+    void refillBoard();
+    void gameCore();
+    void reshuffle();
+    void fillBoard(bool plantMove); // no combination, with plantMove at least one move
+    void applyBonus(int x, int y);
+    void bonusDrop();
+    Step* emit(StepType type, int scoreDelta, Bonus bonus);
+};
+
+// Sizes compiled in engine.cpp
+using GameEngine = BasicEngine<BitBoard<8, 8>>;
+using SmallEngine = BasicEngine<BitBoard<7, 7>>;
+using TinyEngine = BasicEngine<BitBoard<6, 6>>;
+using FlatEngine = BasicEngine<FlatBoard>;
@@ -0,0 +1,313 @@
+#include "flatboard.h"
+#include <cassert>
+
+FlatBoard::FlatBoard(int width, int height, int colors)
+    : w(width)
+    , h(height)
+    , colorCount(colors)
+    , cellData(width * height)
+    , key(0)
+    , marks(width * height, 0)
+    , holeBottom(width, height - 1)
+{
+    assert(width >= 1 && height >= 1 && colors >= 3 && colors <= 8);
+    reserveLists();
+    // The board starts out empty, every column is one big hole
+    for (int x = 0; x < w; x++) {
+        holeColumns.push_back(x);
+    }
+}
+
+FlatBoard::FlatBoard(const FlatBoard& other)
+    : w(other.w)
+    , h(other.h)
+    , colorCount(other.colorCount)
+    , cellData(other.cellData)
+    , key(other.key)
+    , marks(other.marks)
+    , changedCells(other.changedCells)
+    , matchedCells(other.matchedCells)
+    , holeBottom(other.holeBottom)
+    , holeColumns(other.holeColumns)
+{
+    reserveLists();
+}
+
+FlatBoard& FlatBoard::operator=(const FlatBoard& other)
+{
+    w = other.w;
+    h = other.h;
+    colorCount = other.colorCount;
+    cellData = other.cellData;
+    key = other.key;
+    marks = other.marks;
+    changedCells = other.changedCells;
+    matchedCells = other.matchedCells;
+    holeBottom = other.holeBottom;
+    holeColumns = other.holeColumns;
+    reserveLists();
+    return *this;
+}
+
+void FlatBoard::reserveLists()
+{
+    // A cell is on each list at most once, so a move never grows them
+    changedCells.reserve(w * h);
+    matchedCells.reserve(w * h);
+    holeColumns.reserve(w);
+}
+
+void FlatBoard::setColor(int x, int y, int c)
+{
+    int old = cellData[y * w + x].color();
+    if (old >= 0) {
+        key ^= zobrist::key(y * w + x, old);
+    }
+    if (c >= 0) {
+        key ^= zobrist::key(y * w + x, c);
+    }
+    cellData[y * w + x].setColor(c);
+    if (c < 0) {
+        noteHole(x, y);
+    }
+}
+
+void FlatBoard::noteHole(int x, int y)
+{
+    if (holeBottom[x] < 0) {
+        holeColumns.push_back(x);
+    }
+    holeBottom[x] = std::max(holeBottom[x], y);
+}
+
+void FlatBoard::setBonus(int x, int y, Bonus bonus, int brushColor)
+{
+    Cell& cell = cellData[y * w + x];
+    key ^= zobrist::bonusKey(y * w + x, cell.bonus(), cell.brush());
+    key ^= zobrist::bonusKey(y * w + x, bonus, brushColor);
+    cell.setBonus(bonus, brushColor);
+}
+
+void FlatBoard::swapCells(int x1, int y1, int x2, int y2)
+{
+    int a = cellData[y1 * w + x1].color();
+    int b = cellData[y2 * w + x2].color();
+    if (a != b) {
+        // Not through setColor, the swap must not register holes
+        cellData[y1 * w + x1].setColor(b);
+        cellData[y2 * w + x2].setColor(a);
+        if (a >= 0) {
+            key ^= zobrist::key(y1 * w + x1, a) ^ zobrist::key(y2 * w + x2, a);
+        }
+        if (b >= 0) {
+            key ^= zobrist::key(y1 * w + x1, b) ^ zobrist::key(y2 * w + x2, b);
+        }
+    }
+}
+
+void FlatBoard::markChanged(int x, int y)
+{
+    int i = y * w + x;
+    if (!(marks[i] & CHANGED)) {
+        marks[i] |= CHANGED;
+        changedCells.push_back(i);
+    }
+}
+
+void FlatBoard::markAll()
+{
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            markChanged(x, y);
+        }
+    }
+}
+
+void FlatBoard::resetChanged()
+{
+    for (size_t i = 0; i < changedCells.size(); i++) {
+        marks[changedCells[i]] &= ~CHANGED;
+    }
+    changedCells.clear();
+}
+
+// Length of the run of the color of (x, y) along (dx, dy), first gets
+// the index of its first cell
+int FlatBoard::runLength(int x, int y, int dx, int dy, int& first) const
+{
+    int c = cellData[y * w + x].color();
+    int back = 0;
+    while (x - (back + 1) * dx >= 0 && y - (back + 1) * dy >= 0
+        && cellData[(y - (back + 1) * dy) * w + x - (back + 1) * dx].color() == c) {
+        back++;
+    }
+    int ahead = 0;
+    while (x + (ahead + 1) * dx < w && y + (ahead + 1) * dy < h
+        && cellData[(y + (ahead + 1) * dy) * w + x + (ahead + 1) * dx].color() == c) {
+        ahead++;
+    }
+    first = (y - back * dy) * w + x - back * dx;
+    return back + ahead + 1;
+}
+
+bool FlatBoard::hasMatch() const
+{
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            int c = cellData[y * w + x].color();
+            if (c < 0) {
+                continue;
+            }
+            if (x + 2 < w && cellData[y * w + x + 1].color() == c && cellData[y * w + x + 2].color() == c) {
+                return true;
+            }
+            if (y + 2 < h && cellData[(y + 1) * w + x].color() == c && cellData[(y + 2) * w + x].color() == c) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool FlatBoard::hasMatchAround() const
+{
+    for (size_t i = 0; i < changedCells.size(); i++) {
+        int x = changedCells[i] % w;
+        int y = changedCells[i] / w;
+        int first;
+        if (cellData[changedCells[i]].color() >= 0
+            && (runLength(x, y, 1, 0, first) >= 3 || runLength(x, y, 0, 1, first) >= 3)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int FlatBoard::collectMatches()
+{
+    for (size_t i = 0; i < matchedCells.size(); i++) {
+        marks[matchedCells[i]] &= ~(IN_ROW | IN_COLUMN);
+    }
+    matchedCells.clear();
+
+    // Walk the horizontal and vertical run through every changed cell once
+    int count = 0;
+    for (size_t i = 0; i < changedCells.size(); i++) {
+        int cell = changedCells[i];
+        marks[cell] &= ~CHANGED;
+        if (cellData[cell].color() < 0) {
+            continue;
+        }
+        for (int vertical = 0; vertical < 2; vertical++) {
+            uint8_t flag = vertical ? IN_COLUMN : IN_ROW;
+            int step = vertical ? w : 1;
+            int first;
+            if (marks[cell] & flag) {
+                continue;
+            }
+            int length = runLength(cell % w, cell / w, 1 - vertical, vertical, first);
+            if (length < 3) {
+                continue;
+            }
+            count += length;
+            for (int j = 0; j < length; j++) {
+                int run = first + j * step;
+                if (!(marks[run] & (IN_ROW | IN_COLUMN))) {
+                    matchedCells.push_back(run);
+                }
+                marks[run] |= flag;
+            }
+        }
+    }
+    changedCells.clear();
+    std::sort(matchedCells.begin(), matchedCells.end());
+    return count;
+}
+
+void FlatBoard::clearMatched()
+{
+    for (size_t i = 0; i < matchedCells.size(); i++) {
+        setColor(matchedCells[i] % w, matchedCells[i] / w, -1);
+    }
+}
+
+void FlatBoard::gravity()
+{
+    // Only columns with holes are compacted, from their lowest hole up.
+    // Everything at or above that hole may change and is marked.
+    for (size_t i = 0; i < holeColumns.size(); i++) {
+        int x = holeColumns[i];
+        int bottom = holeBottom[x];
+        int landing = bottom;
+        for (int y = bottom; y >= 0; y--) {
+            int c = cellData[y * w + x].color();
+            if (c >= 0) {
+                if (landing != y) {
+                    cellData[y * w + x].setColor(-1);
+                    cellData[landing * w + x].setColor(c);
+                    key ^= zobrist::key(y * w + x, c) ^ zobrist::key(landing * w + x, c);
+                }
+                landing--;
+            }
+            markChanged(x, y);
+        }
+    }
+}
+
+// Would (x, y) be part of a triple if it had color c? The cell
+// (skipX, skipY) is the one the gem comes from and never counts.
+bool FlatBoard::completes(int x, int y, int c, int skipX, int skipY) const
+{
+    auto same = [&](int cx, int cy) {
+        return cx >= 0 && cy >= 0 && cx < w && cy < h && !(cx == skipX && cy == skipY)
+            && cellData[cy * w + cx].color() == c;
+    };
+    int left = same(x - 1, y) ? (same(x - 2, y) ? 2 : 1) : 0;
+    int right = same(x + 1, y) ? (same(x + 2, y) ? 2 : 1) : 0;
+    if (left + right >= 2) {
+        return true;
+    }
+    int up = same(x, y - 1) ? (same(x, y - 2) ? 2 : 1) : 0;
+    int down = same(x, y + 1) ? (same(x, y + 2) ? 2 : 1) : 0;
+    return up + down >= 2;
+}
+
+bool FlatBoard::swapMatches(int x1, int y1, int x2, int y2) const
+{
+    int a = cellData[y1 * w + x1].color();
+    int b = cellData[y2 * w + x2].color();
+    return completes(x2, y2, a, x1, y1) || completes(x1, y1, b, x2, y2);
+}
+
+bool FlatBoard::hasMoves() const
+{
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            if ((x + 1 < w && swapMatches(x, y, x + 1, y)) || (y + 1 < h && swapMatches(x, y, x, y + 1))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool FlatBoard::firstMove(Move& move) const
+{
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x + 1 < w; x++) {
+            if (swapMatches(x, y, x + 1, y)) {
+                move = Move{ x, y, x + 1, y };
+                return true;
+            }
+        }
+    }
+    for (int y = 0; y + 1 < h; y++) {
+        for (int x = 0; x < w; x++) {
+            if (swapMatches(x, y, x, y + 1)) {
+                move = Move{ x, y, x, y + 1 };
+                return true;
+            }
+        }
+    }
+    return false;
+}
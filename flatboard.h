@@ -0,0 +1,134 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "board.h"
+
+// Board of any size stored row by row, one byte per cell, cell (x, y) at
+// index y * width + x.
+// Matching, clearing, gravity and refill only touch the cells around the
+// last changes. The searches for a move or a match (hasMoves, hasMatch,
+// firstMove, forEachMove) walk the grid in reading order: hasMoves runs
+// after every accepted swap and stops at the first move, which on a
+// playable board is usually near the top, but a board with few moves left
+// costs a scan of the whole grid.
+class FlatBoard {
+public:
+    explicit FlatBoard(int width = 8, int height = 8, int colors = 5);
+    FlatBoard(const FlatBoard& other); // with the working lists reserved like the original
+    FlatBoard(FlatBoard&& other) = default;
+    FlatBoard& operator=(const FlatBoard& other); // keeps the working lists reserved too
+    FlatBoard& operator=(FlatBoard&& other) = default;
+
+    int width() const { return w; }
+    int height() const { return h; }
+    int colors() const { return colorCount; }
+    uint64_t hash() const { return key; }
+
+    int colorAt(int x, int y) const { return cellData[y * w + x].color(); }
+    void setColor(int x, int y, int c);
+    Bonus bonusAt(int x, int y) const { return cellData[y * w + x].bonus(); }
+    int brushAt(int x, int y) const { return cellData[y * w + x].brush(); }
+    void setBonus(int x, int y, Bonus bonus, int brushColor);
+    void swapCells(int x1, int y1, int x2, int y2);
+
+    void markChanged(int x, int y);
+    void markAll();
+    void resetChanged();
+
+    bool hasMatch() const;
+    bool hasMatchAround() const;
+    int collectMatches();
+    void clearMatched();
+    void gravity();
+
+    template <class F>
+    void forEachMatched(F f) const
+    {
+        for (size_t i = 0; i < matchedCells.size(); i++) {
+            f(matchedCells[i] % w, matchedCells[i] / w);
+        }
+    }
+
+    template <class F>
+    void forEachMatchedBonus(F f) const
+    {
+        for (size_t i = 0; i < matchedCells.size(); i++) {
+            if (cellData[matchedCells[i]].bonus() != Bonus::NONE) {
+                f(matchedCells[i] % w, matchedCells[i] / w);
+            }
+        }
+    }
+
+    // Fill every empty cell in reading order with randomColor()
+    template <class F>
+    void refill(F randomColor)
+    {
+        std::sort(holeColumns.begin(), holeColumns.end());
+        int deepest = -1;
+        for (size_t i = 0; i < holeColumns.size(); i++) {
+            deepest = std::max(deepest, holeBottom[holeColumns[i]]);
+        }
+        for (int y = 0; y <= deepest; y++) {
+            for (size_t i = 0; i < holeColumns.size(); i++) {
+                int x = holeColumns[i];
+                if (y <= holeBottom[x] && cellData[y * w + x].color() < 0) {
+                    int c = randomColor();
+                    cellData[y * w + x].setColor(c);
+                    key ^= zobrist::key(y * w + x, c);
+                }
+            }
+        }
+        for (size_t i = 0; i < holeColumns.size(); i++) {
+            holeBottom[holeColumns[i]] = -1;
+        }
+        holeColumns.clear();
+    }
+
+    // Horizontal swaps first, then vertical ones, each in reading order
+    template <class F>
+    void forEachMove(F f) const
+    {
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x + 1 < w; x++) {
+                if (swapMatches(x, y, x + 1, y)) {
+                    f(Move{ x, y, x + 1, y });
+                }
+            }
+        }
+        for (int y = 0; y + 1 < h; y++) {
+            for (int x = 0; x < w; x++) {
+                if (swapMatches(x, y, x, y + 1)) {
+                    f(Move{ x, y, x, y + 1 });
+                }
+            }
+        }
+    }
+
+    bool hasMoves() const;
+    bool firstMove(Move& move) const; // the move forEachMove would report first
+
+private:
+    // bits of marks
+    static const uint8_t CHANGED = 1;
+    static const uint8_t IN_ROW = 2; // part of a horizontal run
+    static const uint8_t IN_COLUMN = 4; // part of a vertical run
+
+    int w;
+    int h;
+    int colorCount;
+    std::vector<Cell> cellData;
+    uint64_t key; // Zobrist hash of colors and bonuses
+
+    std::vector<uint8_t> marks;
+    std::vector<int> changedCells; // cells with CHANGED set
+    std::vector<int> matchedCells; // cells of the runs found by collectMatches, in reading order
+    std::vector<int> holeBottom; // lowest emptied row of each column, -1 for none
+    std::vector<int> holeColumns; // columns with holeBottom set
+
+    void noteHole(int x, int y);
+    void reserveLists();
+    int runLength(int x, int y, int dx, int dy, int& first) const;
+    bool completes(int x, int y, int c, int skipX, int skipY) const;
+    bool swapMatches(int x1, int y1, int x2, int y2) const;
+};
@@ -0,0 +1,299 @@
+#include "gameserver.h"
+#include "protocol.h"
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/select.h>
+#endif
+
+// SocketSelector is built on select, which watches at most FD_SETSIZE
+// sockets, and on POSIX only descriptors below FD_SETSIZE. Room is left
+// for the listener and the descriptors the process has open anyway.
+static const size_t SELECT_CONNECTIONS = FD_SETSIZE > 32 ? FD_SETSIZE - 16 : FD_SETSIZE / 2;
+
+GameServer::GameServer(const ServerConfig& config)
+    : config(config)
+    , running(false)
+    , nextConnection(1)
+    , receiveBuffer(RECEIVE_BUFFER)
+{
+    if (this->config.maxConnections == 0 || this->config.maxConnections > SELECT_CONNECTIONS) {
+        this->config.maxConnections = SELECT_CONNECTIONS;
+    }
+    steps.reserve(RESERVED_STEPS, BoardView::WIDTH * BoardView::HEIGHT);
+}
+
+bool GameServer::listen()
+{
+    if (listener.listen(config.port) != sf::Socket::Done) {
+        return false;
+    }
+    listener.setBlocking(false);
+    selector.add(listener);
+    return true;
+}
+
+void GameServer::run()
+{
+    running = true;
+    while (running) {
+        // Answers that did not fit into a socket are retried soon,
+        // otherwise only a request or stop can wake the loop
+        bool backlog = false;
+        for (size_t i = 0; i < connections.size(); i++) {
+            backlog = backlog || !connections[i]->outbox.empty();
+        }
+        if (!selector.wait(sf::milliseconds(backlog ? 1 : 100)) && !backlog) {
+            continue;
+        }
+        if (selector.isReady(listener)) {
+            accept();
+        }
+        for (size_t i = 0; i < connections.size(); i++) {
+            Connection& connection = *connections[i];
+            if (selector.isReady(connection.socket)) {
+                receive(connection);
+            }
+            if (!connection.outbox.empty()) {
+                flush(connection);
+            }
+        }
+        for (size_t i = connections.size(); i-- > 0;) {
+            if (connections[i]->closed) {
+                drop(i);
+            }
+        }
+    }
+}
+
+void GameServer::accept()
+{
+    for (;;) {
+        std::unique_ptr<Connection> connection(new Connection());
+        if (listener.accept(connection->socket) != sf::Socket::Done) {
+            return;
+        }
+        if (connections.size() >= config.maxConnections) {
+            // Past the limit select cannot watch the socket: the client is
+            // told why and the connection closed at once
+            std::vector<uint8_t> answer;
+            protocol::Writer out(answer, protocol::REFUSED);
+            out.put32(0);
+            out.put8(protocol::FULL);
+            out.finish();
+            size_t sent = 0;
+            connection->socket.send(answer.data(), answer.size(), sent);
+            connection->socket.disconnect();
+            stats.refusedConnections++;
+            continue;
+        }
+        connection->socket.setBlocking(false);
+        connection->id = nextConnection++;
+        selector.add(connection->socket);
+        connections.push_back(std::move(connection));
+        stats.connections++;
+    }
+}
+
+void GameServer::receive(Connection& connection)
+{
+    for (;;) {
+        size_t received = 0;
+        sf::Socket::Status status = connection.socket.receive(receiveBuffer.data(), receiveBuffer.size(), received);
+        connection.inbox.insert(connection.inbox.end(), receiveBuffer.begin(), receiveBuffer.begin() + received);
+        if (status == sf::Socket::Disconnected || status == sf::Socket::Error) {
+            connection.closed = true;
+            break;
+        }
+        if (status != sf::Socket::Done || received < receiveBuffer.size()) {
+            break;
+        }
+    }
+
+    // Every complete message is answered, a cut-off one waits for the rest.
+    // A length no request can have means the client is out of step, so it
+    // is refused and the connection closed instead of waiting for the body.
+    size_t offset = 0;
+    size_t length;
+    while (!connection.closed) {
+        protocol::Framing framing = protocol::nextMessage(connection.inbox.data() + offset,
+            connection.inbox.size() - offset, protocol::MAX_REQUEST, length);
+        if (framing == protocol::Framing::TOO_LONG) {
+            refuse(connection, 0, protocol::BAD_MESSAGE);
+            connection.closed = true;
+        }
+        if (framing != protocol::Framing::COMPLETE) {
+            break;
+        }
+        handle(connection, connection.inbox.data() + offset + 2, length);
+        offset += 2 + length;
+    }
+    connection.inbox.erase(connection.inbox.begin(), connection.inbox.begin() + offset);
+}
+
+void GameServer::handle(Connection& connection, const uint8_t* message, size_t length)
+{
+    protocol::Reader in(message, length);
+    uint8_t type = in.get8();
+    if (type == protocol::NEW) {
+        uint64_t seed = in.get64();
+        if (in.isValid() && in.atEnd()) {
+            openSession(connection, seed);
+            return;
+        }
+    }
+    else if (type == protocol::SWAP) {
+        uint32_t id = in.get32();
+        int x1 = in.get8();
+        int y1 = in.get8();
+        int x2 = in.get8();
+        int y2 = in.get8();
+        if (in.isValid() && in.atEnd()) {
+            playMove(connection, id, x1, y1, x2, y2);
+            return;
+        }
+    }
+    else if (type == protocol::CLOSE) {
+        uint32_t id = in.get32();
+        if (in.isValid() && in.atEnd()) {
+            closeSession(connection, id);
+            return;
+        }
+    }
+    refuse(connection, 0, protocol::BAD_MESSAGE);
+}
+
+void GameServer::openSession(Connection& connection, uint64_t seed)
+{
+    uint32_t id;
+    if (!freeSessions.empty()) {
+        id = freeSessions.back();
+        freeSessions.pop_back();
+        sessions[id - 1].engine = GameEngine(Rng(seed));
+    }
+    else if (sessions.size() < config.maxSessions) {
+        sessions.push_back({ GameEngine(Rng(seed)), 0 });
+        id = uint32_t(sessions.size());
+    }
+    else {
+        refuse(connection, 0, protocol::FULL);
+        return;
+    }
+    Session& session = sessions[id - 1];
+    session.owner = connection.id;
+    session.engine.setBonusOdds(config.odds);
+    stats.sessions++;
+
+    BoardView board;
+    session.engine.view(board);
+    protocol::Writer out(connection.outbox, protocol::BOARD);
+    out.put32(id);
+    out.put32(uint32_t(session.engine.getScore()));
+    out.putBoard(board);
+    out.finish();
+}
+
+void GameServer::playMove(Connection& connection, uint32_t id, int x1, int y1, int x2, int y2)
+{
+    Session* session = find(connection, id);
+    if (session == nullptr) {
+        refuse(connection, id, protocol::UNKNOWN_SESSION);
+        return;
+    }
+    GameEngine& engine = session->engine;
+    if (x1 >= engine.getWidth() || y1 >= engine.getHeight() || x2 >= engine.getWidth() || y2 >= engine.getHeight()) {
+        refuse(connection, id, protocol::BAD_MESSAGE);
+        return;
+    }
+    steps.clear();
+    bool accepted = engine.swap(x1, y1, x2, y2, &steps);
+    stats.moves++;
+
+    // The steps that would take the message over MAX_MESSAGE are left out,
+    // the board after the move always goes with it
+    size_t room = protocol::MAX_MESSAGE - (1 + 4 + 1 + 4 + 2 + sizeof(BoardView::cells));
+    size_t count = 0;
+    for (; count < steps.size() && 7 + steps[count].cells.size() <= room; count++) {
+        room -= 7 + steps[count].cells.size();
+    }
+    uint8_t flags = uint8_t((accepted ? protocol::ACCEPTED : 0) | (count < steps.size() ? protocol::STEPS_CUT : 0));
+
+    protocol::Writer out(connection.outbox, protocol::MOVE);
+    out.put32(id);
+    out.put8(flags);
+    out.put32(uint32_t(engine.getScore()));
+    out.put16(uint16_t(count));
+    for (size_t i = 0; i < count; i++) {
+        const Step& step = steps[i];
+        out.put8(uint8_t(step.type));
+        out.put8(uint8_t(step.cascade));
+        out.put32(uint32_t(step.scoreDelta));
+        out.put8(uint8_t(step.cells.size()));
+        for (size_t j = 0; j < step.cells.size(); j++) {
+            out.put8(uint8_t(step.cells[j].y * BoardView::WIDTH + step.cells[j].x));
+        }
+    }
+    BoardView board;
+    engine.view(board);
+    out.putBoard(board);
+    out.finish();
+}
+
+void GameServer::closeSession(Connection& connection, uint32_t id)
+{
+    if (Session* session = find(connection, id)) {
+        session->owner = 0;
+        freeSessions.push_back(id);
+        stats.sessions--;
+    }
+}
+
+void GameServer::refuse(Connection& connection, uint32_t id, uint8_t code)
+{
+    protocol::Writer out(connection.outbox, protocol::REFUSED);
+    out.put32(id);
+    out.put8(code);
+    out.finish();
+}
+
+GameServer::Session* GameServer::find(const Connection& connection, uint32_t id)
+{
+    if (id == 0 || id > sessions.size() || sessions[id - 1].owner != connection.id) {
+        return nullptr;
+    }
+    return &sessions[id - 1];
+}
+
+void GameServer::flush(Connection& connection)
+{
+    while (connection.sent < connection.outbox.size()) {
+        size_t sent = 0;
+        sf::Socket::Status status = connection.socket.send(connection.outbox.data() + connection.sent,
+            connection.outbox.size() - connection.sent, sent);
+        connection.sent += sent;
+        if (status == sf::Socket::Disconnected || status == sf::Socket::Error) {
+            connection.closed = true;
+            return;
+        }
+        if (status != sf::Socket::Done) {
+            return; // the socket is full, the rest goes out in a later round
+        }
+    }
+    connection.outbox.clear();
+    connection.sent = 0;
+}
+
+void GameServer::drop(size_t index)
+{
+    // The sessions of a connection end with it
+    Connection& connection = *connections[index];
+    for (size_t i = 0; i < sessions.size(); i++) {
+        if (sessions[i].owner == connection.id) {
+            closeSession(connection, uint32_t(i + 1));
+        }
+    }
+    selector.remove(connection.socket);
+    connections[index] = std::move(connections.back());
+    connections.pop_back();
+    stats.connections--;
+}
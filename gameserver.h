@@ -0,0 +1,76 @@
+#pragma once
+#include <SFML/Network.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "engine.h"
+
+struct ServerConfig {
+    unsigned short port = 5577; // 0 for any free port
+    size_t maxSessions = 100000;
+    size_t maxConnections = 0; // 0, or more than select can watch: as many as it can
+    BonusOdds odds;
+};
+
+struct ServerStats {
+    long connections = 0; // open right now
+    long sessions = 0; // open right now
+    long moves = 0; // swaps answered since the start
+    long refusedConnections = 0; // turned away at maxConnections
+};
+
+// Hosts the boards of many clients on one thread, see protocol.h. A
+// SocketSelector waits on all sockets at once, every request is answered
+// as soon as it has arrived whole, and answers a slow reader cannot take
+// yet wait in its connection.
+class GameServer {
+public:
+    explicit GameServer(const ServerConfig& config);
+    bool listen(); // false when the port cannot be used
+    unsigned short getPort() const { return listener.getLocalPort(); }
+    void run(); // until stop
+    void stop() { running = false; } // from any thread or a signal handler
+    const ServerStats& getStats() const { return stats; }
+
+private:
+    static const size_t RECEIVE_BUFFER = 1 << 16;
+    static const size_t RESERVED_STEPS = 64; // steps of a move with room made up front
+
+    struct Connection {
+        sf::TcpSocket socket;
+        uint32_t id = 0;
+        std::vector<uint8_t> inbox; // bytes of messages not complete yet
+        std::vector<uint8_t> outbox; // answers not sent yet
+        size_t sent = 0; // bytes of outbox already sent
+        bool closed = false;
+    };
+
+    struct Session {
+        GameEngine engine;
+        uint32_t owner; // connection id, 0 when the slot is free
+    };
+
+    ServerConfig config;
+    sf::TcpListener listener;
+    sf::SocketSelector selector;
+    std::atomic<bool> running;
+    std::vector<std::unique_ptr<Connection>> connections;
+    uint32_t nextConnection;
+    std::vector<Session> sessions; // session id is the index plus one
+    std::vector<uint32_t> freeSessions;
+    StepLog steps; // reused by every move
+    std::vector<uint8_t> receiveBuffer;
+    ServerStats stats;
+
+    void accept();
+    void receive(Connection& connection);
+    void handle(Connection& connection, const uint8_t* message, size_t length);
+    void openSession(Connection& connection, uint64_t seed);
+    void playMove(Connection& connection, uint32_t id, int x1, int y1, int x2, int y2);
+    void closeSession(Connection& connection, uint32_t id);
+    void refuse(Connection& connection, uint32_t id, uint8_t code);
+    Session* find(const Connection& connection, uint32_t id);
+    void flush(Connection& connection);
+    void drop(size_t index);
+};
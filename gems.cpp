@@ -1,549 +1,638 @@
-#include "gems.h"
-#include <random>
-#include <cassert>
-#include <vector>
-
-GameBoard::GameBoard()
-    : score(0)
-    , width(800)
-    , height(900)
-    , selectedX(-1)
-    , selectedY(-1)
-{
-    // initialization
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dist(0, 4);
-
-    for (int x = 0; x < BOARD_WIDTH; x++) {
-        for (int y = 0; y < BOARD_HEIGHT; y++) {
-            board[x][y].setSize(sf::Vector2f(cellSize - 1, cellSize - 1));
-            board[x][y].setPosition(2 + x * cellSize, 2 + y * cellSize);
-            boardData[x][y] = dist(gen);
-            bonusData[x][y] = Bonus::NONE;
-            brushData[x][y] = -1;
-        }
-    }
-    prepareBoard();
-
-    // Font download
-    if (!font.loadFromFile("arial.ttf")) {
-        assert(0);
-    }
-
-    // Initializing Text to Display Points
-    scoreText.setFont(font);
-    scoreText.setCharacterSize(90);
-    scoreText.setFillColor(sf::Color::White);
-    scoreText.setString("Score: " + std::to_string(score));
-    scoreText.setPosition(0, 800);
-}
-
-
-void GameBoard::drawCells(sf::RenderWindow& window) {
-    // Drawing the playing field and chips on the screen
-    for (int x = 0; x < BOARD_WIDTH; x++) {
-        for (int y = 0; y < BOARD_HEIGHT; y++) {
-            board[x][y].setFillColor(colors[boardData[x][y]]);
-            window.draw(board[x][y]);
-
-            // Draw a bonus in the center of the cell
-            switch (bonusData[x][y])
-            {
-            case Bonus::NONE:
-                break;
-            case Bonus::BOMB:
-            {
-                sf::CircleShape circle(cellSize / 4);
-                circle.setFillColor(sf::Color::Black);
-                circle.setPosition(2 + x * cellSize + cellSize / 2 - cellSize / 4, 2 + y * cellSize + cellSize / 2 - cellSize / 4);
-                window.draw(circle);
-                break;
-            }
-            case Bonus::BRUSH:
-            {
-                sf::RectangleShape brush;
-                brush.setSize(sf::Vector2f(cellSize / 2, cellSize / 2));
-                brush.setFillColor(colors[brushData[x][y]]);
-                brush.setPosition(2 + x * cellSize + cellSize / 2 - cellSize / 4, 2 + y * cellSize + cellSize / 2 - cellSize / 4);
-                brush.setOutlineThickness(-3);
-                brush.setOutlineColor(sf::Color::Black);
-                window.draw(brush);
-                break;
-            }
-            default:
-                assert(0);
-            }
-        }
-    }
-    window.draw(scoreText);
-}
-
-void GameBoard::drawGrid(sf::RenderWindow& window)
-{
-    // Create an array of vertices
-    sf::VertexArray grid(sf::Lines);
-
-    // Determine the number of lines horizontally and vertically
-    int numLinesX = width / cellSize + 1;
-    int numLinesY = height / cellSize + 1;
-
-    // Filling the array of vertices
-    for (int i = 0; i < numLinesX; i++) {
-        int x = 1 + i * cellSize;
-        grid.append(sf::Vertex(sf::Vector2f(x, 1), sf::Color::White));
-        grid.append(sf::Vertex(sf::Vector2f(x, 801), sf::Color::White));
-    }
-    for (int i = 0; i < numLinesY; i++) {
-        int y = 1 + i * cellSize;
-        grid.append(sf::Vertex(sf::Vector2f(1, y), sf::Color::White));
-        grid.append(sf::Vertex(sf::Vector2f(width, y), sf::Color::White));
-    }
-
-    // Draw the grid on the screen
-    window.draw(grid);
-}
-
-void GameBoard::drawInter(sf::RenderWindow& window)
-{
-    window.clear(sf::Color::Black);
-    drawGrid(window);
-    drawCells(window);
-    window.display();
-}
-
-void GameBoard::swapCells(int x1, int y1, int x2, int y2) {
-    // Swap cell data
-    int temp = boardData[x1][y1];
-    boardData[x1][y1] = boardData[x2][y2];
-    boardData[x2][y2] = temp;
-
-    // Update board visuals
-    board[x1][y1].setFillColor(colors[boardData[x1][y1]]);
-    board[x2][y2].setFillColor(colors[boardData[x2][y2]]);
-}
-
-bool GameBoard::checkCombo()
-{
-    // Check for horizontal matches
-    for (int y = 0; y < BOARD_HEIGHT; y++) {
-        for (int x = 0; x < BOARD_WIDTH - 2; x++) {
-            if (boardData[x][y] == boardData[x + 1][y] && boardData[x][y] == boardData[x + 2][y]) {
-                return true;
-            }
-        }
-    }
-
-    // Check for vertical matches
-    for (int x = 0; x < BOARD_WIDTH; x++) {
-        for (int y = 0; y < BOARD_HEIGHT - 2; y++) {
-            if (boardData[x][y] == boardData[x][y + 1] && boardData[x][y] == boardData[x][y + 2]) {
-                return true;
-            }
-        }
-    }
-    return false;
-}
-
-void GameBoard::touchBoard(sf::RenderWindow& window)
-{
-    sf::Vector2f mousePos = window.mapPixelToCoords(sf::Mouse::getPosition(window));
-    int x = (mousePos.x) / cellSize;
-    int y = (mousePos.y) / cellSize;
-
-    if (x < BOARD_WIDTH && y < BOARD_HEIGHT) {
-        if (selectedX == -1 && selectedY == -1) {
-            // No cell is currently selected, so select this one
-            selectedX = x;
-            selectedY = y;
-            board[selectedX][selectedY].setOutlineThickness(-3);
-            board[selectedX][selectedY].setOutlineColor(sf::Color::Black);
-        }
-        else if (selectedX == x && selectedY == y) {
-            // This cell is already selected, so deselect it
-            selectedX = -1;
-            selectedY = -1;
-            board[x][y].setOutlineThickness(0);
-        }
-        else if ((selectedX == x && abs(selectedY - y) == 1) || (selectedY == y && abs(selectedX - x) == 1)) {
-            // Two cells are selected and adjacent, so swap them
-            board[selectedX][selectedY].setOutlineThickness(0);
-            swapCells(selectedX, selectedY, x, y);
-            if (checkCombo() == false) {
-                drawInter(window);
-                sf::sleep(sf::milliseconds(500));
-                swapCells(selectedX, selectedY, x, y);
-            }
-            else {
-                gameCore(window);
-            }
-            selectedX = -1;
-            selectedY = -1;
-        }
-        else {
-            // Invalid selection, so deselect the current cell and select the new one
-            board[selectedX][selectedY].setOutlineThickness(0);
-            selectedX = x;
-            selectedY = y;
-            board[selectedX][selectedY].setOutlineThickness(-3);
-            board[selectedX][selectedY].setOutlineColor(sf::Color::Black);
-        }
-    }
-}
-
-void GameBoard::horBonus(std::vector<int>& comb, int y, sf::RenderWindow& window)
-{
-    for (int i = 0; i < comb.size(); i++) {
-        switch (bonusData[comb[i]][y])
-        {
-        case Bonus::NONE:
-            break;
-        case Bonus::BOMB:
-        {
-            std::random_device rd;
-            std::mt19937 gen(rd());
-            std::uniform_int_distribution<> dist(0, 7);
-            for (size_t i = 0; i < 4; i++) {
-                boardData[dist(gen)][dist(gen)] = -1;
-            }
-            score += 50;
-            bonusData[comb[i]][y] = Bonus::NONE;
-            scoreText.setString("Score: " + std::to_string(score));
-            drawInter(window);
-            sf::sleep(sf::milliseconds(1000));
-            break;
-        }
-        case Bonus::BRUSH:
-        {
-            std::random_device rd;
-            std::mt19937 gen(rd());
-            std::uniform_int_distribution<> loc(1, 2);
-            if (loc(gen) == 1) {
-                int x1 = comb[i] - 1;
-                int y1 = y - 1;
-                int x2 = comb[i] + 1;
-                int y2 = y + 1;
-                if (x1 < BOARD_WIDTH && x1 >= 0 && y1 < BOARD_HEIGHT && y1 >= 0) {
-                    boardData[x1][y1] = brushData[comb[i]][y];
-                }
-                if (x2 < BOARD_WIDTH && x2 >= 0 && y2 < BOARD_HEIGHT && y2 >= 0) {
-                    boardData[x2][y2] = brushData[comb[i]][y];
-                }
-            }
-            else {
-                int x1 = comb[i] - 1;
-                int y1 = y + 1;
-                int x2 = comb[i] + 1;
-                int y2 = y - 1;
-                if (x1 < BOARD_WIDTH && x1 >= 0 && y1 < BOARD_HEIGHT && y1 >= 0) {
-                    boardData[x1][y1] = brushData[comb[i]][y];
-                }
-                if (x2 < BOARD_WIDTH && x2 >= 0 && y2 < BOARD_HEIGHT && y2 >= 0) {
-                    boardData[x2][y2] = brushData[comb[i]][y];
-                }
-            }
-            bonusData[comb[i]][y] = Bonus::NONE;
-            brushData[comb[i]][y] = -1;
-            scoreText.setString("Score: " + std::to_string(score));
-            drawInter(window);
-            sf::sleep(sf::milliseconds(1000));
-            break;
-        }
-        default:
-            assert(0);
-        }
-    }
-}
-
-void GameBoard::vertBonus(std::vector<int>& comb, int x, sf::RenderWindow& window)
-{
-    for (int i = 0; i < comb.size(); i++) {
-        switch (bonusData[x][comb[i]])
-        {
-        case Bonus::NONE:
-            break;
-        case Bonus::BOMB:
-        {
-            std::random_device rd;
-            std::mt19937 gen(rd());
-            std::uniform_int_distribution<> dist(0, 7);
-            for (size_t i = 0; i < 4; i++) {
-                boardData[dist(gen)][dist(gen)] = -1;
-            }
-            score += 50;
-            bonusData[x][comb[i]] = Bonus::NONE;
-            scoreText.setString("Score: " + std::to_string(score));
-            drawInter(window);
-            sf::sleep(sf::milliseconds(1000));
-            break;
-        }
-        case Bonus::BRUSH:
-        {
-            std::random_device rd;
-            std::mt19937 gen(rd());
-            std::uniform_int_distribution<> loc(1, 2);
-            if (loc(gen) == 1) {
-                int x1 = x - 1;
-                int y1 = comb[i] - 1;
-                int x2 = x + 1;
-                int y2 = comb[i] + 1;
-                if (x1 < BOARD_WIDTH && x1 >= 0 && y1 < BOARD_HEIGHT && y1 >= 0) {
-                    boardData[x1][y1] = brushData[x][comb[i]];
-                }
-                if (x2 < BOARD_WIDTH && x2 >= 0 && y2 < BOARD_HEIGHT && y2 >= 0) {
-                    boardData[x2][y2] = brushData[x][comb[i]];
-                }
-            }
-            else {
-                int x1 = x - 1;
-                int y1 = comb[i] - 1;
-                int x2 = x + 1;
-                int y2 = comb[i] + 1;
-                if (x1 < BOARD_WIDTH && x1 >= 0 && y1 < BOARD_HEIGHT && y1 >= 0) {
-                    boardData[x1][y1] = brushData[x][comb[i]];
-                }
-                if (x2 < BOARD_WIDTH && x2 >= 0 && y2 < BOARD_HEIGHT && y2 >= 0) {
-                    boardData[x2][y2] = brushData[x][comb[i]];
-                }
-            }
-            bonusData[x][comb[i]] = Bonus::NONE;
-            brushData[x][comb[i]] = -1;
-            scoreText.setString("Score: " + std::to_string(score));
-            drawInter(window);
-            sf::sleep(sf::milliseconds(1000));
-            break;
-        }
-        default:
-            assert(0);
-        }
-    }
-}
-
-void GameBoard::bonusDrop()
-{
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> prob(1, 100);
-    std::uniform_int_distribution<> type(1, 2);
-    std::uniform_int_distribution<> dist(0, 7);
-    std::uniform_int_distribution<> clr(0, 4);
-    unsigned p = prob(gen);
-    unsigned t = type(gen);
-    if (p > 0 && p < 11) {
-        if (t == 1) {
-            bonusData[dist(gen)][dist(gen)] = Bonus::BOMB;
-        }
-        else {
-            int xc = dist(gen);
-            int yc = dist(gen);
-            bonusData[xc][yc] = Bonus::BRUSH;
-            brushData[xc][yc] = clr(gen);
-        }
-    }
-}
-
-void GameBoard::shiftCells()
-{
-    for (int x = 0; x < BOARD_WIDTH; x++) {
-        int shift = 0;
-        for (int y = BOARD_HEIGHT - 1; y >= 0; y--) {
-            if (boardData[x][y] == -1) {
-                shift++;
-                continue;
-            }
-            if (shift > 0) {
-                boardData[x][y + shift] = boardData[x][y];
-                boardData[x][y] = -1;
-            }
-        }
-    }
-}
-
-void GameBoard::gameCore(sf::RenderWindow& window)
-{
-    // Check for horizontal matches
-    for (int y = 0; y < BOARD_HEIGHT; y++) {
-        for (int x = 0; x < BOARD_WIDTH - 2; x++) {
-            if (boardData[x][y] == boardData[x + 1][y] && boardData[x][y] == boardData[x + 2][y]) {
-                std::vector<int> comb;
-                comb.push_back(x);
-                comb.push_back(x + 1);
-                comb.push_back(x + 2);
-                score += 30;
-                int color = boardData[x][y];
-
-                for (int i = x - 1; i >= 0; i--) {
-                    if (boardData[i][y] != color) break;
-                    comb.push_back(i);
-                    score += 10;
-                }
-
-                for (int i = x + 3; i < BOARD_WIDTH; i++) {
-                    if (boardData[i][y] != color) break;
-                    comb.push_back(i);
-                    score += 10;
-                }
-
-                horBonus(comb, y, window);
-
-                for (size_t i = 0; i < comb.size(); i++) {
-                    boardData[comb[i]][y] = -1;
-                }
-
-                scoreText.setString("Score: " + std::to_string(score));
-                drawInter(window);
-                sf::sleep(sf::milliseconds(500));
-
-                bonusDrop();
-
-                shiftCells();
-
-                refillBoard();
-                gameCore(window);
-            }
-        }
-    }
-
-    // Check for vertical matches
-    for (int x = 0; x < BOARD_WIDTH; x++) {
-        for (int y = 0; y < BOARD_HEIGHT - 2; y++) {
-            if (boardData[x][y] == boardData[x][y + 1] && boardData[x][y] == boardData[x][y + 2]) {
-                std::vector<int> comb;
-                comb.push_back(y);
-                comb.push_back(y + 1);
-                comb.push_back(y + 2);
-                int color = boardData[x][y];
-                score += 30;
-
-                for (int i = y - 1; i >= 0; i--) {
-                    if (boardData[x][i] != color) break;
-                    comb.push_back(i);
-                    score += 10;
-                }
-
-                for (int i = y + 3; i < BOARD_WIDTH; i++) {
-                    if (boardData[x][i] != color) break;
-                    comb.push_back(i);
-                    score += 10;
-                }
-
-                vertBonus(comb, x, window);
-
-                for (size_t i = 0; i < comb.size(); i++) {
-                    boardData[x][comb[i]] = -1;
-                }
-
-                scoreText.setString("Score: " + std::to_string(score));
-                drawInter(window);
-                sf::sleep(sf::milliseconds(500));
-
-                bonusDrop();
-
-                shiftCells();
-
-                refillBoard();
-                gameCore(window);
-            }
-        }
-    }
-}
-
-void GameBoard::prepareBoard()
-{
-    // Check for horizontal matches
-    for (int y = 0; y < BOARD_HEIGHT; y++) {
-        for (int x = 0; x < BOARD_WIDTH - 2; x++) {
-            if (boardData[x][y] == boardData[x + 1][y] && boardData[x][y] == boardData[x + 2][y]) {
-
-                int color = boardData[x][y];
-                boardData[x][y] = -1;
-                boardData[x + 1][y] = -1;
-                boardData[x + 2][y] = -1;
-
-                for (int i = x - 1; i >= 0; i--) {
-                    if (boardData[i][y] != color) break;
-                    boardData[i][y] = -1;
-                }
-
-                for (int i = x + 3; i < BOARD_WIDTH; i++) {
-                    if (boardData[i][y] != color) break;
-                    boardData[i][y] = -1;
-                }
-
-                // Remove matched cells and shift the remaining ones down
-                for (int x = 0; x < BOARD_WIDTH; x++) {
-                    int shift = 0;
-                    for (int y = BOARD_HEIGHT - 1; y >= 0; y--) {
-                        if (boardData[x][y] == -1) {
-                            shift++;
-                            continue;
-                        }
-                        if (shift > 0) {
-                            boardData[x][y + shift] = boardData[x][y];
-                            boardData[x][y] = -1;
-                        }
-                    }
-                }
-
-                refillBoard();
-                prepareBoard();
-            }
-        }
-    }
-
-    // Check for vertical matches
-    for (int x = 0; x < BOARD_WIDTH; x++) {
-        for (int y = 0; y < BOARD_HEIGHT - 2; y++) {
-            if (boardData[x][y] == boardData[x][y + 1] && boardData[x][y] == boardData[x][y + 2]) {
-
-                int color = boardData[x][y];
-                boardData[x][y] = -1;
-                boardData[x][y + 1] = -1;
-                boardData[x][y + 2] = -1;
-
-                for (int i = y - 1; i >= 0; i--) {
-                    if (boardData[x][i] != color) break;
-                    boardData[x][i] = -1;
-                }
-
-                for (int i = y + 3; i < BOARD_HEIGHT; i++) {
-                    if (boardData[x][i] != color)
-                        boardData[x][i] = -1;
-                }
-
-                // Remove matched cells and shift the remaining ones down
-                for (int x = 0; x < BOARD_WIDTH; x++) {
-                    int shift = 0;
-                    for (int y = BOARD_HEIGHT - 1; y >= 0; y--) {
-                        if (boardData[x][y] == -1) {
-                            shift++;
-                            continue;
-                        }
-                        if (shift > 0) {
-                            boardData[x][y + shift] = boardData[x][y];
-                            boardData[x][y] = -1;
-                        }
-                    }
-                }
-                refillBoard();
-                prepareBoard();
-            }
-        }
-    }
-}
-
-void GameBoard::refillBoard() {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dist(0, 4);
-
-    // Finding empty cells and filling them with new random cells
-    for (int x = 0; x < BOARD_WIDTH; x++) {
-        for (int y = 0; y < BOARD_HEIGHT; y++) {
-            if (boardData[x][y] == -1) {
-                boardData[x][y] = dist(gen);
-                board[x][y].setFillColor(colors[boardData[x][y]]);
-            }
-        }
-    }
-}
\ No newline at end of file
+#include "gems.h"
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+GameBoard::GameBoard()
+    : simulating(false)
+    , engine(BitBoard<BOARD_WIDTH, BOARD_HEIGHT>(COLORS), Rng(Rng::randomSeed()))
+    , inputPolicy(InputPolicy::BUFFER)
+    , pendingCount(0)
+    , selectedX(-1)
+    , selectedY(-1)
+    , hint()
+    , hintShown(false)
+    , searchCache(SEARCH_CACHE)
+    , searched(engine)
+    , searchResult()
+    , searchFound(false)
+    , searchDone(false)
+    , moves(0)
+    , restored(false)
+    , changed(true)
+    , published(0)
+    , handled(0)
+    , inputTime(0)
+    , cellsWritten(false)
+    , drawCalls(0)
+    , dirty(true)
+    , posted(0)
+    , shownVersion(0)
+    , shownHandled(0)
+    , score(-1)
+    , profilerShown(false)
+    , width(800)
+    , height(900)
+{
+    // initialization
+    buildGrid();
+    cellVertices.setPrimitiveType(sf::Triangles);
+    cellVertices.resize(BOARD_WIDTH * BOARD_HEIGHT * SLOT_VERTICES);
+    for (int i = 0; i < BOMB_SEGMENTS; i++) {
+        float angle = 2 * 3.14159265f * i / BOMB_SEGMENTS;
+        circle[i] = sf::Vector2f(std::cos(angle), std::sin(angle));
+    }
+
+    // Initializing Text to Display Points, drawn from the shared glyph
+    // atlas; the font is loaded only once the profiler is shown
+    scoreText.setFillColor(sf::Color::White);
+    scoreText.setPosition(0, 800);
+    profilerText.setCharacterSize(12);
+    profilerText.setFillColor(sf::Color::White);
+    // One row per phase, no header: seven rows of at most 14 px end above
+    // the bottom of the 900 px window
+    profilerText.setPosition(560, 800);
+
+    // A move and its animation then run without allocating
+    steps.reserve(RESERVED_STEPS, BOARD_WIDTH * BOARD_HEIGHT);
+    timeline.reserve(RESERVED_STEPS, BOARD_WIDTH * BOARD_HEIGHT);
+
+    BoardView view;
+    engine.view(view);
+    timeline.reset(view, engine.getScore());
+    update(0);
+}
+
+void GameBoard::update(float seconds)
+{
+    // Input first, so it is answered in the step it arrived in
+    Input input;
+    while (inputs.pop(input)) {
+        handle(input);
+    }
+    takeBestMove();
+
+    // The frame after an animation ends still has to show the settled board
+    if (timeline.isBusy()) {
+        changed = true;
+    }
+    timeline.advance(seconds);
+
+    // Clicks buffered during the animation are handled once the board settles
+    while (!timeline.isBusy() && pendingCount > 0) {
+        CellPos cell = pending[0];
+        pendingCount--;
+        std::copy(pending + 1, pending + 1 + pendingCount, pending);
+        selectCell(cell.x, cell.y);
+    }
+
+    if (changed) {
+        publish();
+    }
+}
+
+void GameBoard::startSimulation()
+{
+    assert(!simulating);
+    simulating = true;
+    simulation = std::thread(&GameBoard::simulate, this);
+}
+
+void GameBoard::stopSimulation()
+{
+    if (simulating) {
+        simulating = false;
+        simulation.join();
+    }
+    // A search still running ends with its budget
+    if (searcher.joinable()) {
+        searcher.join();
+    }
+}
+
+void GameBoard::simulate()
+{
+    typedef std::chrono::steady_clock Clock;
+    const Clock::duration step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(SIMULATION_STEP));
+    Profiler::attach();
+    Clock::time_point next = Clock::now();
+    while (simulating) {
+        update(SIMULATION_STEP);
+        next += step;
+        // Steps missed by a little are caught up, after a long stall the
+        // animation goes on from where it was
+        Clock::time_point now = Clock::now();
+        if (now - next > MAX_LAG * step) {
+            next = now;
+        }
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void GameBoard::handle(const Input& input)
+{
+    ScopedTimer timer(Phase::INPUT);
+    handled++;
+    inputTime = input.time;
+    changed = true;
+    switch (input.command)
+    {
+    case Command::TOUCH:
+        touch(input.x, input.y);
+        break;
+    case Command::HINT:
+        findHint();
+        break;
+    case Command::BEST_MOVE:
+        findBestMove();
+        break;
+    case Command::SAVE: {
+        Snapshot saved;
+        if (!::saveSnapshot(engine, saved) || !writeSnapshots(snapshotPath, &saved, 1)) {
+            fprintf(stderr, "%s: cannot save the game\n", snapshotPath.c_str());
+        }
+        break;
+    }
+    default:
+        assert(0);
+    }
+}
+
+void GameBoard::publish()
+{
+    Frame& frame = frames.writeSlot();
+    const Step* step = timeline.current();
+    const BoardView& shown = step ? step->board : timeline.settled();
+    for (int x = 0; x < BOARD_WIDTH; x++) {
+        for (int y = 0; y < BOARD_HEIGHT; y++) {
+            CellLook& look = frame.cells[x][y];
+            int color = shown.color(x, y);
+            look.fill = color < 0 ? sf::Color::Black : colors[color];
+            sf::Vector2f offset(0, 0);
+            if (step) {
+                offset = cellOffset(*step, x, y);
+                int before = timeline.settled().color(x, y);
+                if (step->type == StepType::CLEAR && color < 0 && before >= 0) {
+                    // Removed cells fade out
+                    look.fill = colors[before];
+                    look.fill.a = sf::Uint8(255 * (1 - timeline.progress()));
+                }
+            }
+            look.position = sf::Vector2f(2 + (x + offset.x) * cellSize, 2 + (y + offset.y) * cellSize);
+            look.bonus = shown.bonus(x, y);
+            look.brush = shown.brush(x, y);
+            look.frame = sf::Color::Transparent;
+            if (hintShown && ((x == hint.x1 && y == hint.y1) || (x == hint.x2 && y == hint.y2))) {
+                look.frame = sf::Color::White;
+            }
+            if (x == selectedX && y == selectedY) {
+                look.frame = sf::Color::Black;
+            }
+        }
+    }
+    frame.score = timeline.getScore();
+    frame.animating = timeline.isBusy();
+    frame.version = ++published;
+    frame.handled = handled;
+    frame.inputTime = inputTime;
+    frames.publish();
+    changed = false;
+}
+
+sf::Vector2f GameBoard::cellOffset(const Step& step, int x, int y) const
+{
+    // Distance in cells between where a gem is drawn and where it ends the step
+    float rest = 1 - timeline.progress();
+    if (step.type == StepType::SWAP) {
+        for (size_t i = 0; i < step.cells.size(); i++) {
+            if (step.cells[i].x == x && step.cells[i].y == y) {
+                const CellPos& other = step.cells[1 - i];
+                return sf::Vector2f((other.x - x) * rest, (other.y - y) * rest);
+            }
+        }
+    }
+    else if (step.type == StepType::REFILL) {
+        // Gems above a hole fall by the number of holes below them,
+        // new gems come from above the board by the number of holes in the column
+        const BoardView& before = timeline.settled();
+        int landing = BOARD_HEIGHT - 1;
+        for (int from = BOARD_HEIGHT - 1; from >= 0; from--) {
+            if (before.color(x, from) < 0) {
+                continue;
+            }
+            if (landing == y) {
+                return sf::Vector2f(0, (from - y) * rest);
+            }
+            landing--;
+        }
+        return sf::Vector2f(0, -(landing + 1) * rest);
+    }
+    return sf::Vector2f(0, 0);
+}
+
+// Two triangles covering a rectangle
+static void setQuad(sf::Vertex* v, float left, float top, float w, float h, sf::Color color)
+{
+    sf::Vector2f a(left, top), b(left + w, top), c(left + w, top + h), d(left, top + h);
+    v[0] = sf::Vertex(a, color);
+    v[1] = sf::Vertex(b, color);
+    v[2] = sf::Vertex(c, color);
+    v[3] = sf::Vertex(a, color);
+    v[4] = sf::Vertex(c, color);
+    v[5] = sf::Vertex(d, color);
+}
+
+// Border drawn inside a square, like a shape with a negative outline thickness
+static void setFrame(sf::Vertex* v, float left, float top, float size, float thickness, sf::Color color)
+{
+    setQuad(v, left, top, size, thickness, color);
+    setQuad(v + 6, left, top + size - thickness, size, thickness, color);
+    setQuad(v + 12, left, top + thickness, thickness, size - 2 * thickness, color);
+    setQuad(v + 18, left + size - thickness, top + thickness, thickness, size - 2 * thickness, color);
+}
+
+// Hide unused vertices of a cell slot
+static void hideVertices(sf::Vertex* v, int count)
+{
+    for (int i = 0; i < count; i++) {
+        v[i] = sf::Vertex(sf::Vector2f(0, 0), sf::Color::Transparent);
+    }
+}
+
+bool GameBoard::CellLook::operator==(const CellLook& other) const
+{
+    return fill == other.fill && position.x == other.position.x && position.y == other.position.y
+        && bonus == other.bonus && brush == other.brush && frame == other.frame;
+}
+
+void GameBoard::writeCell(int x, int y, const CellLook& look)
+{
+    sf::Vertex* v = &cellVertices[(x * BOARD_HEIGHT + y) * SLOT_VERTICES];
+    float size = cellSize - 1;
+    setQuad(v, look.position.x, look.position.y, size, size, look.fill);
+    v += QUAD_VERTICES;
+
+    if (look.frame != sf::Color::Transparent) {
+        setFrame(v, look.position.x, look.position.y, size, 3, look.frame);
+    }
+    else {
+        hideVertices(v, FRAME_VERTICES);
+    }
+    v += FRAME_VERTICES;
+
+    // Bonuses stay in the middle of their cell while gems move through it
+    float centerX = 2 + x * cellSize + cellSize / 2;
+    float centerY = 2 + y * cellSize + cellSize / 2;
+    float radius = cellSize / 4;
+    switch (look.bonus)
+    {
+    case Bonus::NONE:
+        hideVertices(v, BONUS_VERTICES);
+        break;
+    case Bonus::BOMB:
+        for (int i = 0; i < BOMB_SEGMENTS; i++) {
+            const sf::Vector2f& p = circle[i];
+            const sf::Vector2f& q = circle[(i + 1) % BOMB_SEGMENTS];
+            v[3 * i] = sf::Vertex(sf::Vector2f(centerX, centerY), sf::Color::Black);
+            v[3 * i + 1] = sf::Vertex(sf::Vector2f(centerX + p.x * radius, centerY + p.y * radius), sf::Color::Black);
+            v[3 * i + 2] = sf::Vertex(sf::Vector2f(centerX + q.x * radius, centerY + q.y * radius), sf::Color::Black);
+        }
+        break;
+    case Bonus::BRUSH:
+        setQuad(v, centerX - radius, centerY - radius, 2 * radius, 2 * radius, colors[look.brush]);
+        setFrame(v + QUAD_VERTICES, centerX - radius, centerY - radius, 2 * radius, 3, sf::Color::Black);
+        hideVertices(v + QUAD_VERTICES + FRAME_VERTICES, BONUS_VERTICES - QUAD_VERTICES - FRAME_VERTICES);
+        break;
+    default:
+        assert(0);
+    }
+}
+
+void GameBoard::drawCells(sf::RenderTarget& target, const Frame& frame) {
+    ScopedTimer timer(Phase::CELLS);
+    if (frame.score != score) {
+        // Formatted only when the shown value changes
+        score = frame.score;
+        char text[32];
+        snprintf(text, sizeof(text), "Score: %d", score);
+        scoreText.setString(text);
+    }
+
+    // Only the cells that look different from the last frame are rewritten
+    for (int x = 0; x < BOARD_WIDTH; x++) {
+        for (int y = 0; y < BOARD_HEIGHT; y++) {
+            const CellLook& look = frame.cells[x][y];
+            if (!cellsWritten || !(look == drawn[x][y])) {
+                writeCell(x, y, look);
+                drawn[x][y] = look;
+            }
+        }
+    }
+    cellsWritten = true;
+
+    target.draw(cellVertices);
+    target.draw(scoreText);
+    drawCalls += 2;
+}
+
+void GameBoard::drawGrid(sf::RenderTarget& target)
+{
+    ScopedTimer timer(Phase::GRID);
+    target.draw(gridLines);
+    drawCalls++;
+}
+
+void GameBoard::buildGrid()
+{
+    // Determine the number of lines horizontally and vertically
+    int numLinesX = width / cellSize + 1;
+    int numLinesY = height / cellSize + 1;
+
+    // Filling the array of vertices
+    gridLines.setPrimitiveType(sf::Lines);
+    for (int i = 0; i < numLinesX; i++) {
+        int x = 1 + i * cellSize;
+        gridLines.append(sf::Vertex(sf::Vector2f(x, 1), sf::Color::White));
+        gridLines.append(sf::Vertex(sf::Vector2f(x, 801), sf::Color::White));
+    }
+    for (int i = 0; i < numLinesY; i++) {
+        int y = 1 + i * cellSize;
+        gridLines.append(sf::Vertex(sf::Vector2f(1, y), sf::Color::White));
+        gridLines.append(sf::Vertex(sf::Vector2f(width, y), sf::Color::White));
+    }
+}
+
+void GameBoard::render(sf::RenderTarget& target)
+{
+    draw(target, frames.read());
+}
+
+void GameBoard::draw(sf::RenderTarget& target, const Frame& frame)
+{
+    drawCalls = 0;
+    drawGrid(target);
+    drawCells(target, frame);
+    if (profilerShown) {
+        // Sorting the windows every frame would show up in the numbers
+        if (profilerClock.getElapsedTime().asSeconds() >= PROFILER_REFRESH) {
+            profilerClock.restart();
+            profilerText.setString(Profiler::instance().report());
+        }
+        target.draw(profilerText);
+        drawCalls++;
+    }
+    shownVersion = frame.version;
+}
+
+void GameBoard::drawInter(sf::RenderWindow& window)
+{
+    const Frame& frame = frames.read();
+    window.clear(sf::Color::Black);
+    draw(window, frame);
+    {
+        // Mostly waiting for the vertical sync or the frame limit
+        ScopedTimer timer(Phase::DISPLAY);
+        window.display();
+    }
+    dirty = false;
+
+    // The first frame on screen that answers an input ends its latency
+    if (frame.handled != shownHandled) {
+        shownHandled = frame.handled;
+        if (Profiler::isActive()) {
+            Profiler::instance().record(Phase::LATENCY, frame.inputTime, Profiler::now() - frame.inputTime);
+        }
+    }
+}
+
+bool GameBoard::needsRedraw()
+{
+    // While an input is on its way or the board is animating, the
+    // simulation publishes a frame within a step
+    const Frame& frame = frames.read();
+    return dirty || frame.version != shownVersion || frame.animating || frame.handled != posted
+        || (profilerShown && profilerClock.getElapsedTime().asSeconds() >= PROFILER_REFRESH);
+}
+
+void GameBoard::post(Command command, int x, int y)
+{
+    // A full queue means the simulation is far behind, the input is dropped
+    if (inputs.push({ command, x, y, Profiler::now() })) {
+        posted++;
+    }
+}
+
+void GameBoard::toggleProfiler()
+{
+    profilerShown = !profilerShown;
+    Profiler::instance().setEnabled(profilerShown);
+    if (profilerShown) {
+        profilerText.setFont(GlyphAtlas::font());
+    }
+    profilerClock.restart();
+    profilerText.setString("");
+    dirty = true;
+}
+
+void GameBoard::touchBoard(sf::RenderWindow& window, sf::Vector2i pixel)
+{
+    sf::Vector2f mousePos = window.mapPixelToCoords(pixel);
+    int x = (mousePos.x) / cellSize;
+    int y = (mousePos.y) / cellSize;
+    touchCell(x, y);
+}
+
+void GameBoard::touchCell(int x, int y)
+{
+    post(Command::TOUCH, x, y);
+}
+
+void GameBoard::showHint()
+{
+    post(Command::HINT);
+}
+
+void GameBoard::showBestMove()
+{
+    post(Command::BEST_MOVE);
+}
+
+void GameBoard::saveSnapshot()
+{
+    post(Command::SAVE);
+}
+
+void GameBoard::touch(int x, int y)
+{
+    if (x < 0 || y < 0 || x >= BOARD_WIDTH || y >= BOARD_HEIGHT) {
+        return;
+    }
+    if (timeline.isBusy()) {
+        if (inputPolicy == InputPolicy::BUFFER && pendingCount < MAX_PENDING) {
+            pending[pendingCount++] = { x, y };
+        }
+        return;
+    }
+    selectCell(x, y);
+}
+
+void GameBoard::findHint()
+{
+    if (!timeline.isBusy()) {
+        hintShown = engine.hint(hint);
+    }
+}
+
+void GameBoard::findBestMove()
+{
+    // The search takes SEARCH_BUDGET, many simulation steps, so it runs on a
+    // thread of its own with a copy of the board and the steps go on
+    if (timeline.isBusy() || searcher.joinable()) {
+        return;
+    }
+    searched = engine;
+    searchDone = false;
+    searcher = std::thread([this]() {
+        SearchConfig config;
+        config.budget = SEARCH_BUDGET;
+        config.seed = Rng::randomSeed();
+        config.cache = &searchCache;
+        searchFound = searchMove(searched, config, searchResult);
+        searchDone.store(true, std::memory_order_release);
+    });
+}
+
+void GameBoard::takeBestMove()
+{
+    if (!searcher.joinable() || !searchDone.load(std::memory_order_acquire)) {
+        return;
+    }
+    searcher.join();
+    // A move played meanwhile makes the answer one for another board
+    if (searched.getScore() == engine.getScore() && searched.getHash() == engine.getHash()) {
+        hintShown = searchFound;
+        hint = searchResult.move;
+        changed = true;
+    }
+}
+
+GameBoard::~GameBoard()
+{
+    stopSimulation();
+    if (journal.isOpen() && moves % JOURNAL_CHECKPOINT != 0) {
+        journal.recordCheckpoint(journalChecksum(engine));
+    }
+    if (!journal.close()) {
+        fprintf(stderr, "cannot write the journal\n");
+    }
+}
+
+bool GameBoard::startJournal(const std::string& path)
+{
+    // The header only describes the game as it was created
+    assert(moves == 0);
+    return !restored && journal.open(path, journalHeader(engine));
+}
+
+bool GameBoard::loadSnapshot(const Snapshot& saved)
+{
+    if (timeline.isBusy() || journal.isOpen() || searcher.joinable()) {
+        return false;
+    }
+    GameEngine loaded = engine;
+    if (!::loadSnapshot(loaded, saved)) {
+        return false;
+    }
+    engine = loaded;
+    restored = true;
+    pendingCount = 0;
+    selectedX = -1;
+    selectedY = -1;
+    hintShown = false;
+    searchCache.clear();
+    BoardView view;
+    engine.view(view);
+    timeline.reset(view, engine.getScore());
+    publish();
+    return true;
+}
+
+void GameBoard::selectCell(int x, int y)
+{
+    changed = true;
+    hintShown = false;
+    if (selectedX == -1 && selectedY == -1) {
+        // No cell is currently selected, so select this one
+        selectedX = x;
+        selectedY = y;
+    }
+    else if (selectedX == x && selectedY == y) {
+        // This cell is already selected, so deselect it
+        selectedX = -1;
+        selectedY = -1;
+    }
+    else if ((selectedX == x && abs(selectedY - y) == 1) || (selectedY == y && abs(selectedX - x) == 1)) {
+        // Two cells are selected and adjacent, so swap them
+        steps.clear();
+        bool accepted = engine.swap(selectedX, selectedY, x, y, &steps);
+        if (accepted) {
+            moves++;
+            if (journal.isOpen()) {
+                bool written = journal.recordSwap(Move{ selectedX, selectedY, x, y });
+                if (written && moves % JOURNAL_CHECKPOINT == 0) {
+                    written = journal.recordCheckpoint(journalChecksum(engine));
+                }
+                if (!written) {
+                    // The replay still checks the moves up to the last checkpoint written
+                    fprintf(stderr, "cannot write the journal, recording stopped\n");
+                    journal.close();
+                }
+            }
+        }
+        playSteps(accepted);
+        selectedX = -1;
+        selectedY = -1;
+    }
+    else {
+        // Invalid selection, so deselect the current cell and select the new one
+        selectedX = x;
+        selectedY = y;
+    }
+}
+
+float GameBoard::stepDuration(StepType type) const
+{
+    // seconds
+    switch (type)
+    {
+    case StepType::SWAP:
+        return 0.15f;
+    case StepType::BONUS:
+        return 0.6f;
+    case StepType::CLEAR:
+        return 0.3f;
+    case StepType::REFILL:
+        return 0.25f;
+    case StepType::SHUFFLE:
+        return 0.4f;
+    default:
+        assert(0);
+    }
+    return 0;
+}
+
+void GameBoard::playSteps(bool accepted)
+{
+    for (size_t i = 0; i < steps.size(); i++) {
+        timeline.push(steps[i], stepDuration(steps[i].type));
+    }
+
+    if (!accepted && !steps.empty()) {
+        // Swap the cells back into place on screen as well
+        Step& back = timeline.push(steps.back(), stepDuration(StepType::SWAP));
+        engine.view(back.board);
+    }
+}
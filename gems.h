@@ -1,46 +1,198 @@
-#pragma once
-#include <SFML/Graphics.hpp>
-#include <random>
-#include <cassert>
-#include <vector>
-
-enum class Bonus {
-    NONE
-    , BOMB
-    , BRUSH
-};
-
-class GameBoard {
-public:
-    GameBoard();
-    void drawInter(sf::RenderWindow& window);
-    void touchBoard(sf::RenderWindow& window);
-private:
-    static const int BOARD_WIDTH = 8; // table size
-    static const int BOARD_HEIGHT = 8;
-    const int cellSize = 100; // cell size
-    sf::RectangleShape board[BOARD_WIDTH][BOARD_HEIGHT];
-    sf::Color colors[5] = { sf::Color::Red, sf::Color::Green, sf::Color::Blue,  sf::Color::Yellow, sf::Color::Magenta };
-    int boardData[BOARD_WIDTH][BOARD_HEIGHT]; // colors of cells
-    Bonus bonusData[BOARD_WIDTH][BOARD_HEIGHT]; // bonus information
-    int brushData[BOARD_WIDTH][BOARD_HEIGHT]; // colors of brushes
-    int score; // Points storage box
-    sf::Font font; // Font to display text
-    sf::Text scoreText; // Text to display points
-    int selectedX; // Selected Cell Coordinates
-    int selectedY;
-    int width; // size of window
-    int height;
-
-    void drawCells(sf::RenderWindow& window);
-    void swapCells(int x1, int y1, int x2, int y2);
-    void drawGrid(sf::RenderWindow& window);
-    bool checkCombo();
-    void refillBoard();
-    void gameCore(sf::RenderWindow& window);
-    void prepareBoard();
-    void horBonus(std::vector<int>& comb, int y, sf::RenderWindow& window);
-    void vertBonus(std::vector<int>& comb, int x, sf::RenderWindow& window);
-    void bonusDrop();
-    void shiftCells();
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <atomic>
+#include <cassert>
+#include <string>
+#include <thread>
+#include <vector>
+#include "engine.h"
+#include "glyphatlas.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "player.h"
+#include "profiler.h"
+#include "spscqueue.h"
+#include "timeline.h"
+#include "triplebuffer.h"
+
+// What happens to clicks that arrive while a move is still being animated
+enum class InputPolicy {
+    REJECT // ignore them
+    , BUFFER // replay them once the board has settled
+};
+
+// How the main loop decides when to draw a frame
+enum class RenderMode {
+    CONTINUOUS // every loop iteration, as fast as possible
+    , ON_DEMAND // only when the board changed or is animating, input is polled in between
+    , WAIT // like ON_DEMAND, but blocks in waitEvent while nothing happens
+};
+
+struct RenderPolicy {
+    RenderMode mode = RenderMode::WAIT;
+    unsigned frameLimit = 60; // frames per second, 0 for no limit
+};
+
+// The game is split between a simulation (rules, animation clock,
+// selection) and the window (input events, drawing). The simulation
+// publishes a Frame, everything needed to draw the board, through a triple
+// buffer, and the window sends it clicks and keys through a queue, so
+// neither ever waits for the other. startSimulation runs the simulation in
+// fixed steps on a thread of its own; without it the window thread calls
+// update itself.
+class GameBoard {
+public:
+    GameBoard();
+    ~GameBoard();
+
+    // Simulation side, before startSimulation from the window thread
+    void update(float seconds); // handle the queued input and advance the animation
+    bool isAnimating() const { return timeline.isBusy(); }
+    void startSimulation();
+    void stopSimulation();
+    void setInputPolicy(InputPolicy policy) { inputPolicy = policy; }
+    bool startJournal(const std::string& path); // record every swap, only before the first one
+    bool loadSnapshot(const Snapshot& saved); // continue a saved game, false while animating
+    void setSnapshotPath(const std::string& path) { snapshotPath = path; }
+
+    // Window side
+    void drawInter(sf::RenderWindow& window);
+    void render(sf::RenderTarget& target); // draw the latest frame without clearing or presenting
+    int getDrawCalls() const { return drawCalls; } // draw calls issued by the last render
+    bool needsRedraw(); // a new frame is there or will be soon
+    void invalidate() { dirty = true; } // the window contents were lost
+    void touchBoard(sf::RenderWindow& window, sf::Vector2i pixel);
+    void touchCell(int x, int y); // same as a click into the cell
+    void showHint(); // frame a swap that makes a combination
+    void showBestMove(); // frame the swap the Monte Carlo player prefers
+    void saveSnapshot(); // the settled board, score and generator, to the snapshot path
+    void toggleProfiler(); // time the frame phases and show them next to the score
+private:
+    static const int BOARD_WIDTH = BoardView::WIDTH; // table size
+    static const int BOARD_HEIGHT = BoardView::HEIGHT;
+    static const int COLORS = 5; // number of cell colors
+    static const size_t MAX_PENDING = 4; // clicks kept under InputPolicy::BUFFER
+    static const size_t RESERVED_STEPS = 64; // steps of a move, and steps queued for the animation, with room made up front
+    static const size_t INPUT_QUEUE = 64; // inputs the simulation has not taken yet
+    static constexpr float SIMULATION_STEP = 1.0f / 240; // seconds
+    static const int MAX_LAG = 30; // steps the simulation may fall behind before it skips ahead
+    static constexpr double SEARCH_BUDGET = 0.05; // seconds showBestMove may think
+    static const size_t SEARCH_CACHE = 4096; // evaluations kept between searches
+    static const int JOURNAL_CHECKPOINT = 50; // moves between checkpoints of the journal
+    static constexpr float PROFILER_REFRESH = 0.25f; // seconds between updates of the overlay
+    const int cellSize = 100; // cell size
+
+    // Vertices of one cell in cellVertices: the gem, the selection frame and the bonus
+    static const int QUAD_VERTICES = 6;
+    static const int FRAME_VERTICES = 4 * QUAD_VERTICES;
+    static const int BOMB_SEGMENTS = 24;
+    static const int BONUS_VERTICES = 3 * BOMB_SEGMENTS;
+    static const int SLOT_VERTICES = QUAD_VERTICES + FRAME_VERTICES + BONUS_VERTICES;
+
+    // Everything that decides how a cell is drawn
+    struct CellLook {
+        sf::Color fill;
+        sf::Vector2f position;
+        Bonus bonus;
+        int brush;
+        sf::Color frame; // selection or hint frame, transparent for none
+        bool operator==(const CellLook& other) const;
+    };
+
+    // What the window draws, written by the simulation and never changed after
+    struct Frame {
+        CellLook cells[BOARD_WIDTH][BOARD_HEIGHT];
+        int score; // displayed points
+        bool animating; // the next frames are on their way
+        uint32_t version; // counts the frames published
+        uint32_t handled; // inputs taken from the queue so far
+        int64_t inputTime; // when the last of them arrived, Profiler::now()
+    };
+
+    enum class Command {
+        TOUCH // click into cell x, y
+        , HINT
+        , BEST_MOVE
+        , SAVE
+    };
+
+    struct Input {
+        Command command;
+        int x;
+        int y;
+        int64_t time; // Profiler::now() when the event arrived
+    };
+
+    // Shared by the two sides
+    SpscQueue<Input, INPUT_QUEUE> inputs;
+    TripleBuffer<Frame> frames;
+    std::thread simulation;
+    std::atomic<bool> simulating;
+    sf::Color colors[COLORS] = { sf::Color::Red, sf::Color::Green, sf::Color::Blue,  sf::Color::Yellow, sf::Color::Magenta };
+
+    // Simulation side
+    GameEngine engine; // board state and rules, 8x8 cells
+    Timeline timeline; // steps of the last moves still being shown
+    InputPolicy inputPolicy;
+    CellPos pending[MAX_PENDING]; // clicks waiting for the animation to end, oldest first
+    size_t pendingCount;
+    StepLog steps; // of the last move, reused so a move does not allocate
+    int selectedX; // Selected Cell Coordinates
+    int selectedY;
+    Move hint; // cells framed by showHint
+    bool hintShown;
+    SearchCache searchCache; // asking again about the same board refines the answer; the searcher's while it runs
+    std::thread searcher; // best move search, off the simulation steps
+    GameEngine searched; // copy of the board the searcher works on
+    SearchResult searchResult; // written by the searcher
+    bool searchFound; // written by the searcher
+    std::atomic<bool> searchDone; // the searcher has finished, its result can be taken
+    JournalWriter journal;
+    int moves; // swaps accepted so far
+    bool restored; // loaded from a snapshot, which a journal header cannot describe
+    std::string snapshotPath;
+    bool changed; // something to publish
+    uint32_t published; // frames published so far
+    uint32_t handled; // inputs taken so far
+    int64_t inputTime; // arrival of the last input taken
+
+    // Window side
+    sf::VertexArray gridLines; // built once
+    sf::VertexArray cellVertices; // all cells and bonuses, drawn in one call
+    CellLook drawn[BOARD_WIDTH][BOARD_HEIGHT]; // what cellVertices currently shows
+    bool cellsWritten; // cellVertices has been filled at least once
+    sf::Vector2f circle[BOMB_SEGMENTS]; // unit circle outline for bombs
+    int drawCalls;
+    bool dirty; // the window needs a frame even without a new one from the simulation
+    uint32_t posted; // inputs put into the queue so far
+    uint32_t shownVersion; // frame drawn last
+    uint32_t shownHandled; // inputs answered by the frames displayed so far
+    int score; // points in scoreText
+    AtlasText scoreText; // Text to display points
+    sf::Text profilerText; // frame phase times, right of the score
+    bool profilerShown;
+    sf::Clock profilerClock; // since profilerText was updated
+    int width; // size of window
+    int height;
+
+    // Simulation side
+    void simulate(); // body of the simulation thread
+    void handle(const Input& input);
+    void touch(int x, int y);
+    void findHint();
+    void findBestMove();
+    void takeBestMove();
+    void selectCell(int x, int y);
+    void playSteps(bool accepted);
+    float stepDuration(StepType type) const;
+    sf::Vector2f cellOffset(const Step& step, int x, int y) const;
+    void publish();
+
+    // Window side
+    void post(Command command, int x = 0, int y = 0);
+    void draw(sf::RenderTarget& target, const Frame& frame);
+    void drawCells(sf::RenderTarget& target, const Frame& frame);
+    void drawGrid(sf::RenderTarget& target);
+    void buildGrid();
+    void writeCell(int x, int y, const CellLook& look);
 };
\ No newline at end of file
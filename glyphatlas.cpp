@@ -0,0 +1,267 @@
+#include "glyphatlas.h"
+#include "mappedfile.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+const char* const GlyphAtlas::CHARACTERS = "Score: 0123456789-";
+const char* const GlyphAtlas::FONT_PATH = "arial.ttf";
+const char* const GlyphAtlas::CACHE_PATH = "arial.atlas";
+
+static const char MAGIC[4] = { 'G', 'E', 'M', 'A' };
+static const int PADDING = 1; // transparent pixels kept around a glyph, the font pages have two
+
+GlyphAtlas& GlyphAtlas::shared()
+{
+    static GlyphAtlas atlas;
+    return atlas;
+}
+
+const sf::Font& GlyphAtlas::font()
+{
+    static sf::Font loaded;
+    static bool done = false;
+    if (!done) {
+        // Font download
+        if (!loaded.loadFromFile(FONT_PATH)) {
+            assert(0);
+        }
+        done = true;
+    }
+    return loaded;
+}
+
+GlyphAtlas::GlyphAtlas()
+{
+    if (!load(CACHE_PATH, fontSize())) {
+        bake();
+    }
+}
+
+const GlyphAtlas::Glyph* GlyphAtlas::find(char c) const
+{
+    const char* found = c != 0 ? strchr(CHARACTERS, c) : nullptr;
+    return found ? &glyphs[found - CHARACTERS] : nullptr;
+}
+
+float GlyphAtlas::kerning(char first, char second) const
+{
+    size_t count = glyphs.size();
+    return kernings[(find(first) - glyphs.data()) * count + (find(second) - glyphs.data())];
+}
+
+bool GlyphAtlas::load(const std::string& path, uint32_t fontBytes)
+{
+    MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(Header)) {
+        return false;
+    }
+    Header header;
+    memcpy(&header, file.data(), sizeof(header));
+    size_t count = strlen(CHARACTERS);
+    size_t glyphBytes = count * sizeof(Glyph);
+    size_t kerningBytes = count * count * sizeof(float);
+    // A cache of another version, size, character set or font is made
+    // again; without the font any cache has to do
+    if (memcmp(header.magic, MAGIC, 4) != 0 || header.version != VERSION || header.characterSize != SIZE
+        || header.count != count || strncmp(header.characters, CHARACTERS, sizeof(header.characters)) != 0
+        || (fontBytes != 0 && header.fontBytes != fontBytes)
+        || file.size() != sizeof(Header) + glyphBytes + kerningBytes + size_t(header.width) * header.height) {
+        return false;
+    }
+    const uint8_t* bytes = file.data() + sizeof(Header);
+    glyphs.resize(count);
+    memcpy(glyphs.data(), bytes, glyphBytes);
+    kernings.resize(count * count);
+    memcpy(kernings.data(), bytes + glyphBytes, kerningBytes);
+    upload(bytes + glyphBytes + kerningBytes, header.width, header.height);
+    return true;
+}
+
+void GlyphAtlas::bake()
+{
+    // The font renders every glyph into its page first, the page is read
+    // back once and the glyphs are copied into one row
+    const sf::Font& source = font();
+    size_t count = strlen(CHARACTERS);
+    std::vector<sf::Glyph> rendered;
+    for (size_t i = 0; i < count; i++) {
+        rendered.push_back(source.getGlyph(sf::Uint8(CHARACTERS[i]), SIZE, false));
+    }
+    sf::Image page = source.getTexture(SIZE).copyToImage();
+
+    unsigned width = 0;
+    unsigned height = 0;
+    glyphs.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        const sf::Glyph& from = rendered[i];
+        Glyph& glyph = glyphs[i];
+        glyph.advance = from.advance;
+        glyph.x = int32_t(width);
+        glyph.y = 0;
+        if (from.textureRect.width == 0) {
+            // Nothing to draw, a space
+            glyph.left = glyph.top = glyph.width = glyph.height = 0;
+            continue;
+        }
+        glyph.left = from.bounds.left - PADDING;
+        glyph.top = from.bounds.top - PADDING;
+        glyph.width = float(from.textureRect.width + 2 * PADDING);
+        glyph.height = float(from.textureRect.height + 2 * PADDING);
+        width += unsigned(glyph.width);
+        height = std::max(height, unsigned(glyph.height));
+    }
+
+    std::vector<uint8_t> alpha(size_t(width) * height, 0);
+    for (size_t i = 0; i < count; i++) {
+        const sf::IntRect& rect = rendered[i].textureRect;
+        const Glyph& glyph = glyphs[i];
+        for (int y = 0; y < int(glyph.height); y++) {
+            for (int x = 0; x < int(glyph.width); x++) {
+                sf::Color pixel = page.getPixel(rect.left - PADDING + x, rect.top - PADDING + y);
+                alpha[size_t(y) * width + glyph.x + x] = pixel.a;
+            }
+        }
+    }
+
+    kernings.resize(count * count);
+    for (size_t a = 0; a < count; a++) {
+        for (size_t b = 0; b < count; b++) {
+            kernings[a * count + b] = source.getKerning(sf::Uint8(CHARACTERS[a]), sf::Uint8(CHARACTERS[b]), SIZE);
+        }
+    }
+
+    if (!save(CACHE_PATH, fontSize(), alpha, width, height)) {
+        fprintf(stderr, "%s: cannot write the glyph cache\n", CACHE_PATH);
+    }
+    upload(alpha.data(), width, height);
+}
+
+bool GlyphAtlas::save(const std::string& path, uint32_t fontBytes, const std::vector<uint8_t>& alpha, unsigned width,
+    unsigned height) const
+{
+    Header header = {};
+    assert(strlen(CHARACTERS) < sizeof(header.characters));
+    memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.characterSize = SIZE;
+    header.fontBytes = fontBytes;
+    header.count = uint32_t(glyphs.size());
+    header.width = width;
+    header.height = height;
+    strncpy(header.characters, CHARACTERS, sizeof(header.characters) - 1);
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    // A file cut short by a failed write has the wrong size and is not loaded
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(glyphs.data(), sizeof(Glyph), glyphs.size(), file) == glyphs.size()
+        && fwrite(kernings.data(), sizeof(float), kernings.size(), file) == kernings.size()
+        && fwrite(alpha.data(), 1, alpha.size(), file) == alpha.size();
+    return fclose(file) == 0 && written;
+}
+
+void GlyphAtlas::upload(const uint8_t* alpha, unsigned width, unsigned height)
+{
+    // White pixels with the coverage in alpha, like the pages of sf::Font
+    size_t pixels = size_t(width) * height;
+    std::vector<sf::Uint8> rgba(pixels * 4, 255);
+    for (size_t i = 0; i < pixels; i++) {
+        rgba[4 * i + 3] = alpha[i];
+    }
+    if (!texture.create(width, height)) {
+        assert(0);
+    }
+    texture.update(rgba.data());
+    texture.setSmooth(true);
+}
+
+uint32_t GlyphAtlas::fontSize()
+{
+    FILE* file = fopen(FONT_PATH, "rb");
+    if (file == nullptr) {
+        return 0;
+    }
+    long size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : 0;
+    fclose(file);
+    return size > 0 ? uint32_t(size) : 0;
+}
+
+AtlasText::AtlasText()
+    : vertices(sf::Triangles)
+    , color(sf::Color::White)
+    , fallback(false)
+{
+}
+
+void AtlasText::setString(const char* value)
+{
+    string = value;
+    build();
+}
+
+void AtlasText::setFillColor(const sf::Color& value)
+{
+    color = value;
+    build();
+}
+
+void AtlasText::build()
+{
+    const GlyphAtlas& atlas = GlyphAtlas::shared();
+    vertices.clear();
+    fallback = false;
+    for (size_t i = 0; i < string.size(); i++) {
+        fallback = fallback || atlas.find(string[i]) == nullptr;
+    }
+    if (fallback) {
+        // The first such text loads the font
+        text.setFont(GlyphAtlas::font());
+        text.setCharacterSize(GlyphAtlas::SIZE);
+        text.setFillColor(color);
+        text.setString(string);
+        return;
+    }
+
+    // Laid out as sf::Text does it: the baseline one character size down,
+    // the pen moved by the kerning and the advance of every character
+    float x = 0;
+    float baseline = float(GlyphAtlas::SIZE);
+    for (size_t i = 0; i < string.size(); i++) {
+        const GlyphAtlas::Glyph& glyph = *atlas.find(string[i]);
+        if (i > 0) {
+            x += atlas.kerning(string[i - 1], string[i]);
+        }
+        if (glyph.width > 0) {
+            float left = x + glyph.left;
+            float top = baseline + glyph.top;
+            float right = left + glyph.width;
+            float bottom = top + glyph.height;
+            float u1 = float(glyph.x);
+            float v1 = float(glyph.y);
+            float u2 = u1 + glyph.width;
+            float v2 = v1 + glyph.height;
+            vertices.append(sf::Vertex(sf::Vector2f(left, top), color, sf::Vector2f(u1, v1)));
+            vertices.append(sf::Vertex(sf::Vector2f(right, top), color, sf::Vector2f(u2, v1)));
+            vertices.append(sf::Vertex(sf::Vector2f(right, bottom), color, sf::Vector2f(u2, v2)));
+            vertices.append(sf::Vertex(sf::Vector2f(left, top), color, sf::Vector2f(u1, v1)));
+            vertices.append(sf::Vertex(sf::Vector2f(right, bottom), color, sf::Vector2f(u2, v2)));
+            vertices.append(sf::Vertex(sf::Vector2f(left, bottom), color, sf::Vector2f(u1, v2)));
+        }
+        x += glyph.advance;
+    }
+}
+
+void AtlasText::draw(sf::RenderTarget& target, sf::RenderStates states) const
+{
+    states.transform *= getTransform();
+    if (fallback) {
+        target.draw(text, states);
+        return;
+    }
+    states.texture = &GlyphAtlas::shared().getTexture();
+    target.draw(vertices, states);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The few characters the board shows in large type, rasterized once into
+// a small texture of their own. The atlas is kept in a cache file next to
+// the font and mapped on the next start, so a board is drawn without
+// loading the font. One atlas and one font serve every board.
+class GlyphAtlas {
+public:
+    static const unsigned SIZE = 90; // character size in pixels
+    static const char* const CHARACTERS; // what the atlas holds
+    static const char* const FONT_PATH;
+    static const char* const CACHE_PATH;
+
+    // Where a character is in the texture and where it goes relative to
+    // the pen on the baseline, as sf::Glyph with a pixel of padding around
+    struct Glyph {
+        float advance;
+        float left;
+        float top;
+        float width;
+        float height;
+        int32_t x;
+        int32_t y;
+    };
+
+    static GlyphAtlas& shared(); // made on first use
+    static const sf::Font& font(); // the full font, loaded on first use, for any other text
+
+    const Glyph* find(char c) const; // null for a character outside the atlas
+    float kerning(char first, char second) const;
+    const sf::Texture& getTexture() const { return texture; }
+
+private:
+    static const uint32_t VERSION = 1;
+
+    // Cache file: this header, a Glyph per character, the kerning of every
+    // pair of characters, then the alpha of the atlas row by row. It is
+    // remade when the font file changes size.
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t characterSize;
+        uint32_t fontBytes;
+        uint32_t count; // characters
+        uint32_t width; // of the atlas
+        uint32_t height;
+        char characters[36]; // CHARACTERS, zero padded
+    };
+
+    std::vector<Glyph> glyphs; // in the order of CHARACTERS
+    std::vector<float> kernings; // count x count, first character by row
+    sf::Texture texture;
+
+    GlyphAtlas();
+    bool load(const std::string& path, uint32_t fontBytes);
+    void bake();
+    bool save(const std::string& path, uint32_t fontBytes, const std::vector<uint8_t>& alpha, unsigned width,
+        unsigned height) const;
+    void upload(const uint8_t* alpha, unsigned width, unsigned height);
+    static uint32_t fontSize(); // bytes of the font file, 0 when it is missing
+};
+
+// Text in the atlas size, drawn from the atlas in one call while every
+// character is there, and with the full font otherwise
+class AtlasText : public sf::Drawable, public sf::Transformable {
+public:
+    AtlasText();
+    void setString(const char* text);
+    void setFillColor(const sf::Color& color);
+
+private:
+    sf::VertexArray vertices; // two triangles per character
+    std::string string;
+    sf::Color color;
+    bool fallback; // some character is outside the atlas
+    sf::Text text; // for the fallback
+
+    void build();
+    void draw(sf::RenderTarget& target, sf::RenderStates states) const override;
+};
@@ -0,0 +1,268 @@
+#include "journal.h"
+#include <algorithm>
+#include <cstring>
+
+static const uint8_t MAGIC[4] = { 'G', 'E', 'M', 'J' };
+static const uint8_t WIDE_SWAP = 0x80;
+static const uint8_t CHECKPOINT = 0xff;
+static const int WIDE_CELLS = 1 << 13;
+
+bool JournalWriter::open(const std::string& path, const JournalHeader& header)
+{
+    close();
+    // The header has a byte for each side
+    if (header.width > 255 || header.height > 255 || header.width * header.height > WIDE_CELLS) {
+        return false;
+    }
+    file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    width = header.width;
+    uint8_t bytes[JournalHeader::SIZE] = {};
+    memcpy(bytes, MAGIC, 4);
+    bytes[4] = JournalHeader::VERSION;
+    bytes[5] = uint8_t(header.kind);
+    bytes[6] = uint8_t(header.width);
+    bytes[7] = uint8_t(header.height);
+    bytes[8] = uint8_t(header.colors);
+    bytes[9] = uint8_t(header.odds.dropPercent);
+    bytes[10] = uint8_t(header.odds.bombPercent);
+    for (int i = 0; i < 8; i++) {
+        bytes[12 + i] = uint8_t(header.seed >> (8 * i));
+    }
+    buffer.assign(bytes, bytes + JournalHeader::SIZE);
+    return flush();
+}
+
+bool JournalWriter::recordSwap(const Move& move)
+{
+    // Stored from the left or upper cell
+    int x = std::min(move.x1, move.x2);
+    int y = std::min(move.y1, move.y2);
+    int cell = y * width + x;
+    int down = move.x1 == move.x2 ? 1 : 0;
+    if (cell < 64) {
+        buffer.push_back(uint8_t(down << 6 | cell));
+    }
+    else {
+        buffer.push_back(uint8_t(WIDE_SWAP | down << 5 | cell >> 8));
+        buffer.push_back(uint8_t(cell));
+    }
+    if (buffer.size() >= BUFFER) {
+        flush();
+    }
+    return !failed;
+}
+
+bool JournalWriter::recordCheckpoint(uint32_t checksum)
+{
+    buffer.push_back(CHECKPOINT);
+    for (int i = 0; i < 4; i++) {
+        buffer.push_back(uint8_t(checksum >> (8 * i)));
+    }
+    // A crash loses at most the moves since the last checkpoint
+    if (flush() && fflush(file) != 0) {
+        failed = true;
+    }
+    return !failed;
+}
+
+bool JournalWriter::flush()
+{
+    // Nothing is written after a failed write, it may have left half a record
+    if (!failed && fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+        failed = true;
+    }
+    buffer.clear();
+    return !failed;
+}
+
+bool JournalWriter::close()
+{
+    if (file == nullptr) {
+        return true;
+    }
+    bool written = flush();
+    written = fclose(file) == 0 && written;
+    file = nullptr;
+    failed = false;
+    return written;
+}
+
+bool JournalReader::open(const std::string& path, bool mapped)
+{
+    close();
+    if (mapped) {
+        if (!mapping.open(path)) {
+            return false;
+        }
+        cursor = mapping.data();
+        end = cursor + mapping.size();
+    }
+    else {
+        file = fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            return false;
+        }
+        buffer.resize(BUFFER);
+    }
+
+    uint8_t bytes[JournalHeader::SIZE];
+    for (int i = 0; i < JournalHeader::SIZE; i++) {
+        int byte = readByte();
+        if (byte < 0) {
+            close();
+            return false;
+        }
+        bytes[i] = uint8_t(byte);
+    }
+    if (memcmp(bytes, MAGIC, 4) != 0 || bytes[4] != JournalHeader::VERSION
+        || (bytes[5] != uint8_t(Rng::Kind::XOSHIRO) && bytes[5] != uint8_t(Rng::Kind::MT19937))) {
+        close();
+        return false;
+    }
+    header.kind = Rng::Kind(bytes[5]);
+    header.width = bytes[6];
+    header.height = bytes[7];
+    header.colors = bytes[8];
+    header.odds.dropPercent = bytes[9];
+    header.odds.bombPercent = bytes[10];
+    header.seed = 0;
+    for (int i = 0; i < 8; i++) {
+        header.seed |= uint64_t(bytes[12 + i]) << (8 * i);
+    }
+    return true;
+}
+
+void JournalReader::close()
+{
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+    mapping.close();
+    cursor = nullptr;
+    end = nullptr;
+}
+
+bool JournalReader::refill()
+{
+    if (file == nullptr) {
+        return false; // a mapping holds the whole file already
+    }
+    size_t count = fread(buffer.data(), 1, buffer.size(), file);
+    cursor = buffer.data();
+    end = cursor + count;
+    return count > 0;
+}
+
+JournalReader::Record JournalReader::next(Move& move, uint32_t& checksum)
+{
+    int byte = readByte();
+    if (byte < 0) {
+        return Record::END;
+    }
+    if (byte == CHECKPOINT) {
+        checksum = 0;
+        for (int i = 0; i < 4; i++) {
+            int part = readByte();
+            if (part < 0) {
+                return Record::CORRUPT;
+            }
+            checksum |= uint32_t(part) << (8 * i);
+        }
+        return Record::CHECKPOINT;
+    }
+
+    int cell;
+    bool down;
+    if (byte < WIDE_SWAP) {
+        cell = byte & 0x3f;
+        down = (byte & 0x40) != 0;
+    }
+    else if (byte < 0xc0) {
+        int low = readByte();
+        if (low < 0) {
+            return Record::CORRUPT;
+        }
+        cell = (byte & 0x1f) << 8 | low;
+        down = (byte & 0x20) != 0;
+    }
+    else {
+        return Record::CORRUPT;
+    }
+    move.x1 = cell % header.width;
+    move.y1 = cell / header.width;
+    move.x2 = move.x1 + (down ? 0 : 1);
+    move.y2 = move.y1 + (down ? 1 : 0);
+    if (move.x2 >= header.width || move.y2 >= header.height) {
+        return Record::CORRUPT;
+    }
+    return Record::SWAP;
+}
+
+template <class Engine>
+static void replayOn(Engine& engine, JournalReader& reader, ReplayReport& report)
+{
+    engine.setBonusOdds(reader.getHeader().odds);
+    Move move;
+    uint32_t checksum;
+    for (;;) {
+        JournalReader::Record record = reader.next(move, checksum);
+        if (record == JournalReader::Record::SWAP) {
+            // Only swaps that made a combination are recorded
+            if (!engine.swap(move.x1, move.y1, move.x2, move.y2)) {
+                report.diverged = true;
+                report.illegal = true;
+                report.divergedAt = report.moves;
+                break;
+            }
+            report.moves++;
+        }
+        else if (record == JournalReader::Record::CHECKPOINT) {
+            uint32_t actual = journalChecksum(engine);
+            if (actual != checksum) {
+                report.diverged = true;
+                report.divergedAt = report.moves;
+                report.expected = checksum;
+                report.actual = actual;
+                break;
+            }
+            report.checkpoints++;
+        }
+        else {
+            report.corrupt = record == JournalReader::Record::CORRUPT;
+            break;
+        }
+    }
+    report.score = engine.getScore();
+}
+
+ReplayReport replayJournal(JournalReader& reader)
+{
+    // The compiled bitboard sizes are used where they fit, as in the game
+    const JournalHeader& header = reader.getHeader();
+    Rng rng(header.seed, header.kind);
+    ReplayReport report;
+    if (header.colors < 3 || header.colors > 8 || header.width < 1 || header.height < 1) {
+        report.corrupt = true;
+    }
+    else if (header.width == 8 && header.height == 8) {
+        GameEngine engine(BitBoard<8, 8>(header.colors), rng);
+        replayOn(engine, reader, report);
+    }
+    else if (header.width == 7 && header.height == 7) {
+        SmallEngine engine(BitBoard<7, 7>(header.colors), rng);
+        replayOn(engine, reader, report);
+    }
+    else if (header.width == 6 && header.height == 6) {
+        TinyEngine engine(BitBoard<6, 6>(header.colors), rng);
+        replayOn(engine, reader, report);
+    }
+    else {
+        FlatEngine engine(FlatBoard(header.width, header.height, header.colors), rng);
+        replayOn(engine, reader, report);
+    }
+    return report;
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "engine.h"
+#include "mappedfile.h"
+
+// Replay journal: what a session started from and every swap played in it.
+// All numbers are little endian.
+//
+//   header, 20 bytes: "GEMJ", version, generator kind, width, height,
+//                     colors, drop percent, bomb percent, 0, seed (8 bytes)
+//   records:
+//     0x00-0x7f  swap of cell y * width + x (bits 0-5) with its right
+//                neighbour, or with the one below when bit 6 is set
+//     0x80-0xbf  the same for boards of up to 8192 cells: bit 5 is the
+//                direction, bits 0-4 and the next byte the cell
+//     0xff       checkpoint, the journalChecksum of the board follows
+//                in 4 bytes
+struct JournalHeader {
+    static const uint8_t VERSION = 2; // 2: boards are generated in one pass, see fillBoard
+    static const int SIZE = 20;
+
+    Rng::Kind kind = Rng::Kind::XOSHIRO;
+    int width = 8;
+    int height = 8;
+    int colors = 5;
+    BonusOdds odds;
+    uint64_t seed = 0;
+};
+
+// Header of a journal of a game that has just been created
+template <class Engine>
+JournalHeader journalHeader(const Engine& engine)
+{
+    JournalHeader header;
+    header.kind = engine.getRng().getKind();
+    header.width = engine.getWidth();
+    header.height = engine.getHeight();
+    header.colors = engine.getColors();
+    header.odds = engine.getBonusOdds();
+    header.seed = engine.getRng().getSeed();
+    return header;
+}
+
+// Board hash and score folded to 32 bits
+template <class Engine>
+uint32_t journalChecksum(const Engine& engine)
+{
+    uint64_t z = engine.getHash() ^ zobrist::mix(uint64_t(uint32_t(engine.getScore())));
+    return uint32_t(z ^ (z >> 32));
+}
+
+// Appends records to a journal file. Records are buffered and written
+// out at every checkpoint and on close. A failed write stops the
+// recording: every later record and close report it.
+class JournalWriter {
+public:
+    JournalWriter() = default;
+    ~JournalWriter() { close(); }
+    JournalWriter(const JournalWriter&) = delete;
+    JournalWriter& operator=(const JournalWriter&) = delete;
+
+    bool open(const std::string& path, const JournalHeader& header); // false for a side over 255 cells
+    bool isOpen() const { return file != nullptr; }
+    bool recordSwap(const Move& move); // false once a write has failed
+    bool recordCheckpoint(uint32_t checksum);
+    bool close();
+
+private:
+    static const size_t BUFFER = 4096;
+
+    FILE* file = nullptr;
+    int width = 0;
+    bool failed = false; // a write failed, nothing more is written
+    std::vector<uint8_t> buffer;
+
+    bool flush();
+};
+
+// Reads a journal record by record, either through a small buffer or from
+// a memory-mapped file. The journal is never loaded whole.
+class JournalReader {
+public:
+    enum class Record {
+        SWAP
+        , CHECKPOINT
+        , END
+        , CORRUPT // unknown record, cut-off record or a swap off the board
+    };
+
+    JournalReader() = default;
+    ~JournalReader() { close(); }
+    JournalReader(const JournalReader&) = delete;
+    JournalReader& operator=(const JournalReader&) = delete;
+
+    bool open(const std::string& path, bool mapped); // false for a missing file or a bad header
+    void close();
+    const JournalHeader& getHeader() const { return header; }
+    Record next(Move& move, uint32_t& checksum);
+
+private:
+    static const size_t BUFFER = 1 << 16;
+
+    JournalHeader header;
+    FILE* file = nullptr; // null when mapped
+    MappedFile mapping;
+    std::vector<uint8_t> buffer;
+    const uint8_t* cursor = nullptr;
+    const uint8_t* end = nullptr;
+
+    bool refill();
+    int readByte() { return cursor < end || refill() ? *cursor++ : -1; }
+};
+
+struct ReplayReport {
+    long moves = 0; // swaps replayed
+    long checkpoints = 0; // checkpoints that matched
+    bool corrupt = false;
+    bool diverged = false; // a checkpoint did not match or a swap was refused
+    bool illegal = false; // the swap after divergedAt made no combination
+    long divergedAt = 0; // swaps replayed before the failed checkpoint
+    uint32_t expected = 0; // checksum in the journal
+    uint32_t actual = 0; // checksum of the replayed board
+    int score = 0; // score at the end of the replay
+};
+
+// Replay the journal on a new engine built from its header and stop at
+// the first checkpoint that does not match or the first refused swap
+ReplayReport replayJournal(JournalReader& reader);
@@ -0,0 +1,261 @@
+// Load generator for the game server. Opens many sessions over a few
+// connections and keeps every session busy with one swap at a time, then
+// reports the move rate, the sessions one server core can carry and the
+// move latency.
+//
+// Command line: --host ADDRESS (127.0.0.1), --port N (5577),
+// --connections N (8), --sessions N (1000 in total), --seconds S (10),
+// --seed N (session i plays from seed + i), --pace R (moves per second
+// of one human player, 1 by default, for the sessions per core).
+#include "protocol.h"
+#include <SFML/Network.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+
+typedef std::chrono::steady_clock Clock;
+
+struct Session {
+    uint32_t id = 0; // 0 until the server has answered NEW
+    BoardView board;
+    int score = 0;
+    Clock::time_point sentAt;
+};
+
+struct Client {
+    sf::TcpSocket socket;
+    std::vector<Session> sessions; // answers come back in the order of the requests
+    size_t opened = 0; // sessions the server has answered NEW for
+    std::deque<size_t> waiting; // sessions with a SWAP in flight, oldest first
+    std::vector<uint8_t> inbox;
+    std::vector<uint8_t> outbox;
+    size_t sent = 0;
+};
+
+// Any swap that makes a combination, found by loading the board into an engine
+static bool chooseMove(GameEngine& scratch, Rng& rng, const Session& session, Move& move)
+{
+    scratch.load(session.board, session.score, rng);
+    std::vector<Move> moves;
+    scratch.findMoves(moves);
+    if (moves.empty()) {
+        return false;
+    }
+    move = moves[rng.below(int(moves.size()))];
+    return true;
+}
+
+static void sendSwap(Client& client, size_t index, const Move& move)
+{
+    Session& session = client.sessions[index];
+    protocol::Writer out(client.outbox, protocol::SWAP);
+    out.put32(session.id);
+    out.put8(uint8_t(move.x1));
+    out.put8(uint8_t(move.y1));
+    out.put8(uint8_t(move.x2));
+    out.put8(uint8_t(move.y2));
+    out.finish();
+    session.sentAt = Clock::now();
+    client.waiting.push_back(index);
+}
+
+static bool flush(Client& client)
+{
+    while (client.sent < client.outbox.size()) {
+        size_t sent = 0;
+        sf::Socket::Status status = client.socket.send(client.outbox.data() + client.sent,
+            client.outbox.size() - client.sent, sent);
+        client.sent += sent;
+        if (status == sf::Socket::Disconnected || status == sf::Socket::Error) {
+            return false;
+        }
+        if (status != sf::Socket::Done) {
+            return true;
+        }
+    }
+    client.outbox.clear();
+    client.sent = 0;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    std::string host = "127.0.0.1";
+    unsigned short port = 5577;
+    int connections = 8;
+    long sessions = 1000;
+    double seconds = 10;
+    uint64_t seed = 1;
+    double pace = 1;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--host") == 0) {
+            host = argv[++i];
+        }
+        else if (strcmp(argv[i], "--port") == 0) {
+            port = (unsigned short)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--connections") == 0) {
+            connections = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--sessions") == 0) {
+            sessions = std::max(1L, atol(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--seconds") == 0) {
+            seconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--pace") == 0) {
+            pace = std::max(0.001, atof(argv[++i]));
+        }
+    }
+
+    // Sessions are dealt out to the connections in turn
+    std::vector<std::unique_ptr<Client>> clients;
+    sf::SocketSelector selector;
+    for (int i = 0; i < connections; i++) {
+        std::unique_ptr<Client> client(new Client());
+        if (client->socket.connect(sf::IpAddress(host), port) != sf::Socket::Done) {
+            fprintf(stderr, "cannot connect to %s:%u\n", host.c_str(), unsigned(port));
+            return 1;
+        }
+        client->socket.setBlocking(false);
+        selector.add(client->socket);
+        clients.push_back(std::move(client));
+    }
+    for (long i = 0; i < sessions; i++) {
+        Client& client = *clients[i % connections];
+        client.sessions.push_back(Session());
+        protocol::Writer out(client.outbox, protocol::NEW);
+        out.put64(seed + uint64_t(i));
+        out.finish();
+    }
+
+    GameEngine scratch{ Rng(seed) };
+    Rng rng(~seed);
+    std::vector<double> latencies; // milliseconds
+    long refused = 0;
+    long ended = 0; // sessions without a move left, should not happen after a reshuffle
+    std::vector<uint8_t> buffer(1 << 16);
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    bool sending = true;
+    long inFlight = sessions; // NEW and SWAP requests not answered yet
+
+    while (inFlight > 0) {
+        if (sending && Clock::now() >= deadline) {
+            sending = false; // let the requests in flight finish
+        }
+        for (size_t c = 0; c < clients.size(); c++) {
+            if (!flush(*clients[c])) {
+                fprintf(stderr, "the server closed the connection\n");
+                return 1;
+            }
+        }
+        if (!selector.wait(sf::milliseconds(100))) {
+            continue;
+        }
+        for (size_t c = 0; c < clients.size(); c++) {
+            Client& client = *clients[c];
+            if (!selector.isReady(client.socket)) {
+                continue;
+            }
+            size_t received = 0;
+            sf::Socket::Status status = client.socket.receive(buffer.data(), buffer.size(), received);
+            if (status == sf::Socket::Disconnected || status == sf::Socket::Error) {
+                fprintf(stderr, "the server closed the connection\n");
+                return 1;
+            }
+            client.inbox.insert(client.inbox.end(), buffer.begin(), buffer.begin() + received);
+
+            size_t offset = 0;
+            size_t length;
+            while (protocol::nextMessage(client.inbox.data() + offset, client.inbox.size() - offset,
+                protocol::MAX_MESSAGE, length) == protocol::Framing::COMPLETE) {
+                protocol::Reader in(client.inbox.data() + offset + 2, length);
+                offset += 2 + length;
+                uint8_t type = in.get8();
+                size_t index;
+                if (type == protocol::BOARD) {
+                    index = client.opened++;
+                    Session& session = client.sessions[index];
+                    session.id = in.get32();
+                    session.score = int(in.get32());
+                    in.getBoard(session.board);
+                }
+                else if (type == protocol::MOVE) {
+                    index = client.waiting.front();
+                    client.waiting.pop_front();
+                    Session& session = client.sessions[index];
+                    auto now = Clock::now();
+                    latencies.push_back(std::chrono::duration<double, std::milli>(now - session.sentAt).count());
+                    in.get32(); // session id
+                    in.get8(); // flags
+                    session.score = int(in.get32());
+                    int steps = in.get16();
+                    for (int s = 0; s < steps; s++) {
+                        in.get8(); // type
+                        in.get8(); // cascade
+                        in.get32(); // score delta
+                        int cells = in.get8();
+                        for (int i = 0; i < cells; i++) {
+                            in.get8();
+                        }
+                    }
+                    in.getBoard(session.board);
+                }
+                else {
+                    // A refused NEW comes without a session id, a refused
+                    // SWAP with one; either way the session is not played further
+                    if (in.get32() == 0) {
+                        client.opened++;
+                    }
+                    else {
+                        client.waiting.pop_front();
+                    }
+                    refused++;
+                    inFlight--;
+                    continue;
+                }
+                inFlight--;
+                if (!in.isValid()) {
+                    fprintf(stderr, "malformed answer from the server\n");
+                    return 1;
+                }
+                Move move;
+                if (!sending) {
+                    continue;
+                }
+                if (!chooseMove(scratch, rng, client.sessions[index], move)) {
+                    ended++;
+                    continue;
+                }
+                sendSwap(client, index, move);
+                inFlight++;
+            }
+            client.inbox.erase(client.inbox.begin(), client.inbox.begin() + offset);
+        }
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    size_t n = latencies.size();
+    printf("%ld sessions over %d connections, %zu moves in %.1f s\n", sessions, connections, n, elapsed);
+    printf("%.0f moves/s on one server thread\n", n / elapsed);
+    // The server plays every session on one thread, so its move rate is
+    // what one core sustains; players who move at pace need that much less
+    printf("%.0f sessions per core at %g moves/s per player\n", n / elapsed / pace, pace);
+    if (n > 0) {
+        printf("move latency ms: p50 %.3f  p99 %.3f  max %.3f\n", latencies[n / 2],
+            latencies[std::min(n - 1, n * 99 / 100)], latencies[n - 1]);
+    }
+    if (refused > 0 || ended > 0) {
+        printf("%ld requests refused, %ld sessions without a move\n", refused, ended);
+    }
+}
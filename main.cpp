@@ -1,22 +1,117 @@
-#include "gems.h"
-
-int main()
-{
-    sf::RenderWindow window(sf::VideoMode(801, 900), "GEMS");
-    GameBoard game;
-    while (window.isOpen()) {
-        sf::Event event;
-        while (window.pollEvent(event)) {
-            if (event.type == sf::Event::Closed) {
-                window.close();
-            }
-            else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::X) {
-                window.close();
-            }
-            else if (event.type == sf::Event::MouseButtonPressed) {
-                game.touchBoard(window);
-            }
-        }
-        game.drawInter(window);
-    }
+#include "gems.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Command line: --render continuous|demand|wait, --fps N (0 for no limit)
+static RenderPolicy parseRenderPolicy(int argc, char** argv)
+{
+    RenderPolicy policy;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--render") == 0) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "continuous") == 0) {
+                policy.mode = RenderMode::CONTINUOUS;
+            }
+            else if (strcmp(mode, "demand") == 0) {
+                policy.mode = RenderMode::ON_DEMAND;
+            }
+            else {
+                policy.mode = RenderMode::WAIT;
+            }
+        }
+        else if (strcmp(argv[i], "--fps") == 0) {
+            policy.frameLimit = unsigned(atoi(argv[++i]));
+        }
+    }
+    return policy;
+}
+
+int main(int argc, char** argv)
+{
+    RenderPolicy policy = parseRenderPolicy(argc, argv);
+    sf::RenderWindow window(sf::VideoMode(801, 900), "GEMS");
+    window.setFramerateLimit(policy.frameLimit);
+    GameBoard game;
+    // --snapshot FILE continues the game saved there, S saves it again.
+    // --journal FILE records the game for the replay tool.
+    // --trace FILE writes the frame phases as a Chrome trace on exit.
+    std::string snapshotPath = "gems.snap";
+    game.setSnapshotPath(snapshotPath);
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--snapshot") == 0) {
+            snapshotPath = argv[++i];
+            game.setSnapshotPath(snapshotPath);
+            SnapshotFile saved;
+            if (saved.open(snapshotPath) && (saved.size() == 0 || !game.loadSnapshot(saved[0]))) {
+                fprintf(stderr, "%s: not a snapshot of this board\n", argv[i]);
+            }
+        }
+    }
+    const char* tracePath = nullptr;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--journal") == 0 && !game.startJournal(argv[++i])) {
+            fprintf(stderr, "%s: cannot record the journal\n", argv[i]);
+        }
+        else if (strcmp(argv[i], "--trace") == 0) {
+            tracePath = argv[++i];
+            Profiler::instance().startTrace();
+        }
+    }
+
+    auto handle = [&](const sf::Event& event) {
+        if (event.type == sf::Event::Closed) {
+            window.close();
+        }
+        else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::X) {
+            window.close();
+        }
+        else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::H) {
+            game.showHint();
+        }
+        else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::B) {
+            game.showBestMove();
+        }
+        else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::P) {
+            game.toggleProfiler();
+        }
+        else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::S) {
+            game.saveSnapshot();
+        }
+        else if (event.type == sf::Event::MouseButtonPressed) {
+            game.touchBoard(window, sf::Vector2i(event.mouseButton.x, event.mouseButton.y));
+        }
+        else if (event.type == sf::Event::Resized || event.type == sf::Event::GainedFocus) {
+            game.invalidate();
+        }
+    };
+
+    // The rules and the animation clock run on their own thread, this one
+    // only turns events into input and draws what the simulation publishes
+    game.startSimulation();
+    while (window.isOpen()) {
+        sf::Event event;
+        if (policy.mode == RenderMode::WAIT && !game.needsRedraw()) {
+            // Nothing to animate: sleep until the user does something
+            if (window.waitEvent(event)) {
+                handle(event);
+            }
+        }
+        while (window.pollEvent(event)) {
+            handle(event);
+        }
+
+        if (policy.mode == RenderMode::CONTINUOUS || game.needsRedraw()) {
+            game.drawInter(window);
+        }
+        else if (policy.mode == RenderMode::ON_DEMAND) {
+            // Skip the frame, but do not spin while polling for input
+            sf::sleep(sf::milliseconds(policy.frameLimit ? 1000 / policy.frameLimit : 1));
+        }
+    }
+    game.stopSimulation();
+    if (tracePath && !Profiler::instance().writeTrace(tracePath)) {
+        fprintf(stderr, "%s: cannot write the trace\n", tracePath);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "player.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// Sums of one thread, one entry per candidate
+struct Tally {
+    std::vector<double> points;
+    std::vector<long> rollouts;
+};
+
+// Points of one rollout of candidate, false when the deadline came first
+static bool rollout(const GameEngine& engine, const Move& candidate, int depth, Rng& stream,
+    std::vector<Move>& moves, Clock::time_point deadline, int& points)
+{
+    GameEngine trial = engine;
+    uint64_t high = stream.next();
+    uint64_t low = stream.next();
+    trial.reseed(high << 32 | low);
+    trial.swap(candidate.x1, candidate.y1, candidate.x2, candidate.y2);
+    for (int i = 0; i < depth; i++) {
+        if (Clock::now() >= deadline) {
+            return false;
+        }
+        moves.clear();
+        trial.findMoves(moves);
+        if (moves.empty()) {
+            break;
+        }
+        const Move& move = moves[stream.below(int(moves.size()))];
+        trial.swap(move.x1, move.y1, move.x2, move.y2);
+    }
+    points = trial.getScore() - engine.getScore();
+    return Clock::now() < deadline;
+}
+
+bool searchMove(const GameEngine& engine, const SearchConfig& config, SearchResult& result)
+{
+    Clock::time_point deadline = Clock::now()
+        + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(config.budget));
+    std::vector<Move> candidates;
+    engine.findMoves(candidates);
+    if (candidates.empty()) {
+        return false;
+    }
+    int count = int(candidates.size());
+
+    uint64_t board = engine.getHash();
+    std::vector<uint64_t> keys(count);
+    std::vector<Evaluation> totals(count);
+    for (int i = 0; i < count; i++) {
+        keys[i] = board ^ zobrist::moveKey(candidates[i], engine.getWidth());
+        if (config.cache) {
+            config.cache->find(keys[i], totals[i]);
+        }
+    }
+
+    int threads = config.threads > 0 ? config.threads : int(std::max(1u, std::thread::hardware_concurrency()));
+
+    std::vector<Tally> tallies(threads);
+    auto work = [&](int self) {
+        Tally tally;
+        tally.points.assign(count, 0);
+        tally.rollouts.assign(count, 0);
+        Rng stream(config.seed + uint64_t(self));
+        std::vector<Move> moves;
+        // Threads start at different candidates so that all get rollouts early
+        for (int next = self * count / threads;; next = (next + 1) % count) {
+            int points;
+            if (!rollout(engine, candidates[next], config.depth, stream, moves, deadline, points)) {
+                break;
+            }
+            tally.points[next] += points;
+            tally.rollouts[next]++;
+        }
+        tallies[self] = tally;
+    };
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; i++) {
+        pool.emplace_back(work, i);
+    }
+    work(0);
+    for (size_t i = 0; i < pool.size(); i++) {
+        pool[i].join();
+    }
+
+    // Candidates without a finished rollout are only taken if none has one
+    result.move = candidates[0];
+    result.expected = 0;
+    result.rollouts = 0;
+    double best = -1;
+    for (int i = 0; i < count; i++) {
+        Evaluation& total = totals[i];
+        for (int t = 0; t < threads; t++) {
+            total.points += tallies[t].points[i];
+            total.rollouts += tallies[t].rollouts[i];
+        }
+        if (config.cache && total.rollouts > 0) {
+            config.cache->store(keys[i], total);
+        }
+        result.rollouts += total.rollouts;
+        if (total.rollouts > 0 && total.points / total.rollouts > best) {
+            best = total.points / total.rollouts;
+            result.move = candidates[i];
+            result.expected = best;
+        }
+    }
+    return true;
+}
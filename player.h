@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include "engine.h"
+#include "transposition.h"
+
+// Rollout totals of one move from one board
+struct Evaluation {
+    double points = 0;
+    long rollouts = 0;
+};
+
+// Evaluations keyed by board hash and move. A cache must only be shared by
+// searches with the same depth and bonus odds.
+typedef TranspositionTable<Evaluation> SearchCache;
+
+struct SearchConfig {
+    double budget = 0.05; // seconds until the answer is due
+    int threads = 0; // 0 for one per hardware thread
+    int depth = 3; // random moves played after the candidate in each rollout
+    uint64_t seed = 1; // rollout streams, thread i draws from seed + i
+    SearchCache* cache = nullptr; // rollouts of earlier searches, extended by this one
+};
+
+struct SearchResult {
+    Move move;
+    double expected; // mean points of the move's rollouts
+    long rollouts; // rollouts finished for all moves together, cached ones included
+};
+
+// Monte Carlo player. Every swap that makes a combination is tried on
+// copies of the board with other random futures: the swap, then a few
+// random moves. The threads take the candidates in turn until the budget
+// runs out and the move with the best mean score is returned.
+// Rollouts that would end after the deadline are dropped, so the answer
+// comes in time even when a cascade runs long. With a cache, a board seen
+// before starts from the rollouts it already had. False when there is no move.
+bool searchMove(const GameEngine& engine, const SearchConfig& config, SearchResult& result);
@@ -0,0 +1,146 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+
+thread_local bool Profiler::attached = false;
+thread_local int Profiler::lane = 0;
+std::atomic<bool> Profiler::on(false);
+std::atomic<int> Profiler::lanes(0);
+
+Profiler& Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+int64_t Profiler::now()
+{
+    static const auto origin = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+const char* Profiler::name(Phase phase)
+{
+    switch (phase)
+    {
+    case Phase::INPUT:
+        return "input";
+    case Phase::RULES:
+        return "rules";
+    case Phase::BONUS:
+        return "bonus";
+    case Phase::GRID:
+        return "grid";
+    case Phase::CELLS:
+        return "cells";
+    case Phase::DISPLAY:
+        return "display";
+    case Phase::LATENCY:
+        return "latency";
+    default:
+        assert(0);
+        return "";
+    }
+}
+
+void Profiler::attach()
+{
+    attached = true;
+    if (lane == 0) {
+        lane = ++lanes;
+    }
+}
+
+void Profiler::activate()
+{
+    attach();
+    on = enabled || tracing;
+}
+
+void Profiler::setEnabled(bool value)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    enabled = value;
+    activate();
+}
+
+void Profiler::startTrace()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    events.clear();
+    dropped = 0;
+    tracing = true;
+    activate();
+}
+
+bool Profiler::writeTrace(const std::string& path)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    tracing = false;
+    activate();
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+    // Complete events, times in microseconds
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < events.size(); i++) {
+        const Event& e = events[i];
+        fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+            name(e.phase), e.lane, e.start / 1000.0, e.duration / 1000.0, i + 1 < events.size() ? "," : "");
+    }
+    fprintf(file, "],\"otherData\":{\"dropped\":%ld}}\n", dropped);
+    events.clear();
+    return fclose(file) == 0;
+}
+
+void Profiler::record(Phase phase, int64_t start, int64_t duration)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    int i = int(phase);
+    samples[i][counts[i] % WINDOW] = duration;
+    counts[i]++;
+    if (tracing) {
+        if (events.size() < MAX_EVENTS) {
+            events.push_back({ phase, lane, start, duration });
+        }
+        else {
+            dropped++;
+        }
+    }
+}
+
+Profiler::Summary Profiler::summary(Phase phase) const
+{
+    int i = int(phase);
+    int64_t sorted[WINDOW];
+    Summary result = { 0, 0, 0, 0 };
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        result.count = counts[i];
+        std::copy(samples[i], samples[i] + std::min<long>(counts[i], WINDOW), sorted);
+    }
+    int n = int(std::min<long>(result.count, WINDOW));
+    if (n == 0) {
+        return result;
+    }
+    std::sort(sorted, sorted + n);
+    result.p50 = sorted[n / 2] / 1e3;
+    result.p99 = sorted[std::min(n - 1, n * 99 / 100)] / 1e3;
+    result.max = sorted[n - 1] / 1e3;
+    return result;
+}
+
+std::string Profiler::report() const
+{
+    std::string text;
+    char line[96];
+    for (int i = 0; i < int(Phase::COUNT); i++) {
+        Summary s = summary(Phase(i));
+        snprintf(line, sizeof(line), "%-8s %8.1f %8.1f %8.1f\n", name(Phase(i)), s.p50, s.p99, s.max);
+        text += line;
+    }
+    return text;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Parts of a frame that are timed
+enum class Phase {
+    INPUT // one click or key handled by the simulation
+    , RULES // gameCore, a whole move with its cascade
+    , BONUS // one bonus firing, inside RULES
+    , GRID // drawGrid
+    , CELLS // drawCells
+    , DISPLAY // window.display
+    , LATENCY // from an input event to the displayed frame that shows it
+    , COUNT
+};
+
+// Durations of the last WINDOW runs of every phase, and on request a
+// trace of every run. Only the thread that turned it on and threads that
+// attached are timed: engines copied into search and simulation threads
+// pay one check per timer. Each timed thread is a lane of its own in the
+// trace.
+class Profiler {
+public:
+    static const int WINDOW = 512; // runs the percentiles are taken over
+    static const size_t MAX_EVENTS = 1 << 20; // a longer trace is cut
+
+    // Microseconds over the window
+    struct Summary {
+        long count; // runs since the start, not only in the window
+        double p50;
+        double p99;
+        double max;
+    };
+
+    static Profiler& instance();
+    static bool isActive() { return attached && on.load(std::memory_order_relaxed); } // timing the calling thread
+    static void attach(); // time the calling thread whenever the profiler is on
+    static int64_t now(); // nanoseconds since the process started
+    static const char* name(Phase phase);
+
+    // Both attach the calling thread
+    void setEnabled(bool on);
+    bool isEnabled() const { return enabled; }
+    void startTrace();
+    bool writeTrace(const std::string& path); // Chrome trace JSON, ends the trace
+
+    void record(Phase phase, int64_t start, int64_t duration);
+    Summary summary(Phase phase) const;
+    std::string report() const; // one line per phase
+
+private:
+    struct Event {
+        Phase phase;
+        int lane;
+        int64_t start;
+        int64_t duration;
+    };
+
+    static thread_local bool attached;
+    static thread_local int lane; // trace row of the calling thread
+    static std::atomic<bool> on; // enabled or tracing
+    static std::atomic<int> lanes;
+
+    mutable std::mutex lock; // the timed threads record concurrently
+    bool enabled = false;
+    bool tracing = false;
+    int64_t samples[int(Phase::COUNT)][WINDOW] = {};
+    long counts[int(Phase::COUNT)] = {};
+    std::vector<Event> events;
+    long dropped = 0; // events past MAX_EVENTS
+
+    Profiler() = default;
+    void activate();
+};
+
+// Times the enclosing scope when the profiler is on for this thread
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Phase phase)
+        : phase(phase)
+        , start(Profiler::isActive() ? Profiler::now() : -1)
+    {
+    }
+
+    ~ScopedTimer()
+    {
+        if (start >= 0) {
+            Profiler::instance().record(phase, start, Profiler::now() - start);
+        }
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Phase phase;
+    int64_t start;
+};
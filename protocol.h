@@ -0,0 +1,167 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "engine.h"
+
+// Messages between the game server and its clients. Every message is a
+// 2-byte length of the rest, a 1-byte type and the fields below. All
+// numbers are little endian. A connection can hold any number of sessions,
+// each one a board of its own.
+//
+//   client to server
+//     NEW    seed (8): start a session, answered by BOARD
+//     SWAP   session (4), x1, y1, x2, y2 (1 each): answered by MOVE
+//     CLOSE  session (4): not answered
+//   server to client
+//     BOARD  session (4), score (4), cells (64, see Cell)
+//     MOVE   session (4), flags (1), score (4), step count (2), steps,
+//            cells (64) of the board after the move
+//            flags: ACCEPTED, STEPS_CUT when the last steps did not fit
+//            in MAX_MESSAGE and were left out; the board is always whole
+//            step: type (1), cascade (1), score delta (4), cell count (1),
+//                  cells (1 each, y * 8 + x)
+//     REFUSED session (4), code (1)
+namespace protocol {
+
+static const uint8_t NEW = 1;
+static const uint8_t SWAP = 2;
+static const uint8_t CLOSE = 3;
+static const uint8_t BOARD = 0x81;
+static const uint8_t MOVE = 0x82;
+static const uint8_t REFUSED = 0x83;
+
+// REFUSED codes
+static const uint8_t UNKNOWN_SESSION = 1; // never opened, closed, or opened on another connection
+static const uint8_t BAD_MESSAGE = 2; // unknown type, wrong length or a swap off the board
+static const uint8_t FULL = 3; // no room for another session; as the first answer: for the connection, then closed
+
+// MOVE flags
+static const uint8_t ACCEPTED = 1;
+static const uint8_t STEPS_CUT = 2;
+
+static const size_t MAX_MESSAGE = 0xffff; // longest body a length can describe
+static const size_t MAX_REQUEST = 16; // longest client message, NEW and SWAP take 9 bytes
+
+// Appends one message to a buffer
+class Writer {
+public:
+    Writer(std::vector<uint8_t>& out, uint8_t type)
+        : out(out)
+        , start(out.size())
+    {
+        put16(0); // patched by finish
+        put8(type);
+    }
+
+    void put8(uint8_t value) { out.push_back(value); }
+    void put16(uint16_t value) { putBytes(value, 2); }
+    void put32(uint32_t value) { putBytes(value, 4); }
+    void put64(uint64_t value) { putBytes(value, 8); }
+
+    void putBoard(const BoardView& board)
+    {
+        const uint8_t* cells = &board.cells[0][0].bits;
+        out.insert(out.end(), cells, cells + sizeof(board.cells));
+    }
+
+    size_t length() const { return out.size() - start - 2; } // of the body so far, type included
+
+    // False when the body is longer than MAX_MESSAGE: the message is taken
+    // back out of the buffer rather than sent with a wrong length
+    bool finish()
+    {
+        size_t body = length();
+        if (body > MAX_MESSAGE) {
+            out.resize(start);
+            return false;
+        }
+        out[start] = uint8_t(body);
+        out[start + 1] = uint8_t(body >> 8);
+        return true;
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    size_t start;
+
+    void putBytes(uint64_t value, int count)
+    {
+        for (int i = 0; i < count; i++) {
+            out.push_back(uint8_t(value >> (8 * i)));
+        }
+    }
+};
+
+// Reads the fields of one message, the type already taken. Reading past
+// the end gives zeros and makes isValid false.
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t size)
+        : cursor(data)
+        , end(data + size)
+        , valid(true)
+    {
+    }
+
+    uint8_t get8() { return uint8_t(getBytes(1)); }
+    uint16_t get16() { return uint16_t(getBytes(2)); }
+    uint32_t get32() { return uint32_t(getBytes(4)); }
+    uint64_t get64() { return getBytes(8); }
+
+    void getBoard(BoardView& board)
+    {
+        if (size_t(end - cursor) < sizeof(board.cells)) {
+            valid = false;
+            cursor = end;
+            return;
+        }
+        memcpy(&board.cells[0][0].bits, cursor, sizeof(board.cells));
+        cursor += sizeof(board.cells);
+    }
+
+    bool isValid() const { return valid; }
+    bool atEnd() const { return cursor == end; }
+
+private:
+    const uint8_t* cursor;
+    const uint8_t* end;
+    bool valid;
+
+    uint64_t getBytes(int count)
+    {
+        if (end - cursor < count) {
+            valid = false;
+            cursor = end;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < count; i++) {
+            value |= uint64_t(cursor[i]) << (8 * i);
+        }
+        cursor += count;
+        return value;
+    }
+};
+
+enum class Framing {
+    INCOMPLETE // the rest of the message has not arrived yet
+    , COMPLETE
+    , TOO_LONG // the length is over the limit, the stream cannot be trusted
+};
+
+// Has the first message in data arrived completely? Its length, without
+// the 2 bytes that hold it, goes to length.
+inline Framing nextMessage(const uint8_t* data, size_t size, size_t limit, size_t& length)
+{
+    if (size < 2) {
+        return Framing::INCOMPLETE;
+    }
+    length = size_t(data[0]) | size_t(data[1]) << 8;
+    if (length > limit) {
+        return Framing::TOO_LONG;
+    }
+    return size >= 2 + length ? Framing::COMPLETE : Framing::INCOMPLETE;
+}
+
+}
@@ -0,0 +1,130 @@
+// Verifies replay journals by playing them again and checking every
+// checkpoint, or records journals of random games to verify.
+//
+// Command line: replay [--mmap] FILE... (--mmap maps the files instead of
+// reading them through a buffer). Exits with 1 when a journal is corrupt or
+// does not replay to the same boards.
+//
+// replay --record FILE [--seed N] [--moves N] [--every N] [--size N] writes
+// a journal of N random moves on a board of N x N cells with a checkpoint
+// every N moves.
+#include "journal.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+struct RecordConfig {
+    uint64_t seed = 1;
+    long moves = 100000;
+    int every = 100;
+    int size = 8;
+};
+
+template <class Engine>
+static bool recordGame(Engine& engine, const char* path, const RecordConfig& config)
+{
+    JournalWriter writer;
+    if (!writer.open(path, journalHeader(engine))) {
+        return false;
+    }
+    Rng pick(~config.seed);
+    std::vector<Move> moves;
+    for (long i = 0; i < config.moves; i++) {
+        moves.clear();
+        engine.findMoves(moves);
+        if (moves.empty()) {
+            break;
+        }
+        Move move = moves[pick.below(int(moves.size()))];
+        engine.swap(move.x1, move.y1, move.x2, move.y2);
+        if (!writer.recordSwap(move)) {
+            return false;
+        }
+        if ((i + 1) % config.every == 0 && !writer.recordCheckpoint(journalChecksum(engine))) {
+            return false;
+        }
+    }
+    writer.recordCheckpoint(journalChecksum(engine));
+    return writer.close();
+}
+
+static bool record(const char* path, const RecordConfig& config)
+{
+    Rng rng(config.seed);
+    if (config.size == 8) {
+        GameEngine engine(BitBoard<8, 8>(5), rng);
+        return recordGame(engine, path, config);
+    }
+    FlatEngine engine(FlatBoard(config.size, config.size, 5), rng);
+    return recordGame(engine, path, config);
+}
+
+int main(int argc, char** argv)
+{
+    bool mapped = false;
+    const char* recordPath = nullptr;
+    RecordConfig config;
+    std::vector<const char*> paths;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mmap") == 0) {
+            mapped = true;
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            config.seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--moves") == 0 && i + 1 < argc) {
+            config.moves = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--every") == 0 && i + 1 < argc) {
+            config.every = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            config.size = atoi(argv[++i]);
+        }
+        else {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    if (recordPath) {
+        if (!record(recordPath, config)) {
+            fprintf(stderr, "%s: cannot write the journal\n", recordPath);
+            return 1;
+        }
+        return 0;
+    }
+
+    int status = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+        JournalReader reader;
+        if (!reader.open(paths[i], mapped)) {
+            fprintf(stderr, "%s: not a journal\n", paths[i]);
+            status = 1;
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        ReplayReport report = replayJournal(reader);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        printf("%s: %ld moves, %ld checkpoints, score %d, %.0f moves/s\n", paths[i], report.moves,
+            report.checkpoints, report.score, seconds > 0 ? report.moves / seconds : 0.0);
+        if (report.illegal) {
+            printf("  diverged after move %ld: the next swap makes no combination\n", report.divergedAt);
+            status = 1;
+        }
+        else if (report.diverged) {
+            printf("  diverged after move %ld: checksum %08x, expected %08x\n", report.divergedAt,
+                report.actual, report.expected);
+            status = 1;
+        }
+        if (report.corrupt) {
+            printf("  corrupt after move %ld\n", report.moves);
+            status = 1;
+        }
+    }
+    return status;
+}
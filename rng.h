@@ -0,0 +1,127 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <random>
+
+// Random number source owned by a board. The default generator is
+// xoshiro256**; mt19937 can be selected to keep the old generator.
+// Ranges are mapped without std::uniform_int_distribution, so a seed gives
+// the same sequence with every compiler and standard library.
+class Rng {
+public:
+    enum class Kind {
+        XOSHIRO
+        , MT19937
+    };
+
+    explicit Rng(uint64_t seed = 0, Kind kind = Kind::XOSHIRO)
+        : kind(kind)
+    {
+        reseed(seed);
+    }
+
+    Rng(const Rng& other)
+        : kind(other.kind)
+        , seed(other.seed)
+        , mt(other.mt ? new std::mt19937(*other.mt) : nullptr)
+    {
+        for (int i = 0; i < 4; i++) {
+            state[i] = other.state[i];
+        }
+    }
+
+    Rng& operator=(const Rng& other)
+    {
+        if (this != &other) {
+            kind = other.kind;
+            seed = other.seed;
+            mt.reset(other.mt ? new std::mt19937(*other.mt) : nullptr);
+            for (int i = 0; i < 4; i++) {
+                state[i] = other.state[i];
+            }
+        }
+        return *this;
+    }
+
+    // Seed from the operating system, for boards that do not need replay
+    static uint64_t randomSeed()
+    {
+        std::random_device rd;
+        return (uint64_t(rd()) << 32) ^ rd();
+    }
+
+    void reseed(uint64_t value)
+    {
+        seed = value;
+        // expand the seed with splitmix64 so that nearby seeds give unrelated streams
+        uint64_t z = value;
+        for (int i = 0; i < 4; i++) {
+            z += 0x9e3779b97f4a7c15ull;
+            uint64_t s = z;
+            s = (s ^ (s >> 30)) * 0xbf58476d1ce4e5b9ull;
+            s = (s ^ (s >> 27)) * 0x94d049bb133111ebull;
+            state[i] = s ^ (s >> 31);
+        }
+        if (kind == Kind::MT19937) {
+            mt.reset(new std::mt19937(uint32_t(value ^ (value >> 32))));
+        }
+        else {
+            mt.reset();
+        }
+    }
+
+    Kind getKind() const { return kind; }
+    uint64_t getSeed() const { return seed; }
+
+    // Position in the xoshiro256** stream. The mt19937 state is 2.5 KB and
+    // is not saved this way.
+    void saveState(uint64_t out[4]) const
+    {
+        assert(kind == Kind::XOSHIRO);
+        for (int i = 0; i < 4; i++) {
+            out[i] = state[i];
+        }
+    }
+
+    void restoreState(uint64_t seedValue, const uint64_t in[4])
+    {
+        kind = Kind::XOSHIRO;
+        seed = seedValue;
+        mt.reset();
+        for (int i = 0; i < 4; i++) {
+            state[i] = in[i];
+        }
+    }
+
+    // 32 uniformly distributed bits
+    uint32_t next()
+    {
+        if (kind == Kind::MT19937) {
+            return uint32_t((*mt)());
+        }
+        uint64_t result = rotl(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return uint32_t(result >> 32);
+    }
+
+    // Uniform integer in [0, n)
+    int below(int n)
+    {
+        return int((uint64_t(next()) * uint32_t(n)) >> 32);
+    }
+
+private:
+    Kind kind;
+    uint64_t seed;
+    uint64_t state[4]; // xoshiro256** state
+    std::unique_ptr<std::mt19937> mt; // only allocated for Kind::MT19937
+
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
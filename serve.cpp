@@ -0,0 +1,60 @@
+// Game server: hosts boards for clients over TCP, see protocol.h.
+//
+// Command line: --port N (5577 by default, 0 for any free port),
+// --sessions N (most boards open at once), --connections N (most clients
+// at once, at most what select can watch), --drop P, --bomb P (bonus odds
+// in percent as in simulate). Runs until interrupted.
+#include "gameserver.h"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static GameServer* server = nullptr;
+
+static void interrupt(int)
+{
+    server->stop();
+}
+
+int main(int argc, char** argv)
+{
+    ServerConfig config;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0) {
+            config.port = (unsigned short)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--sessions") == 0) {
+            config.maxSessions = size_t(atol(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--connections") == 0) {
+            config.maxConnections = size_t(atol(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--drop") == 0) {
+            config.odds.dropPercent = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bomb") == 0) {
+            config.odds.bombPercent = atoi(argv[++i]);
+        }
+    }
+
+    GameServer game(config);
+    if (!game.listen()) {
+        fprintf(stderr, "cannot listen on port %u\n", unsigned(config.port));
+        return 1;
+    }
+    printf("listening on port %u\n", unsigned(game.getPort()));
+    fflush(stdout);
+
+    server = &game;
+    signal(SIGINT, interrupt);
+    signal(SIGTERM, interrupt);
+    game.run();
+
+    const ServerStats& stats = game.getStats();
+    printf("%ld moves answered, %ld sessions and %ld connections still open\n", stats.moves, stats.sessions,
+        stats.connections);
+    if (stats.refusedConnections > 0) {
+        printf("%ld connections refused at the limit\n", stats.refusedConnections);
+    }
+}
@@ -0,0 +1,95 @@
+// Batch simulation of many games without a window, for tuning the rules.
+//
+// Command line: --games N, --moves N (per game), --threads N (0 for all
+// cores), --seed N, --policy first|random|greedy|search, --drop P (percent
+// chance of a bonus after a cascade step), --bomb P (percent of bombs among
+// them), --budget MS (time the search policy has for a move, 5 by default).
+#include "player.h"
+#include "simulator.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void printHistogram(const char* title, const std::vector<long>& bars, int width, long total)
+{
+    printf("%s\n", title);
+    for (size_t i = 0; i < bars.size(); i++) {
+        if (bars[i] > 0) {
+            printf("  %8ld %10ld %6.2f%%\n", long(i) * width, bars[i], 100.0 * bars[i] / total);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    SimConfig config;
+    SearchCache cache(size_t(1) << 20);
+    double budget = 0.005;
+    const char* policy = "first";
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--games") == 0) {
+            config.games = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--moves") == 0) {
+            config.movesPerGame = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0) {
+            config.threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0) {
+            config.seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--drop") == 0) {
+            config.odds.dropPercent = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bomb") == 0) {
+            config.odds.bombPercent = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--budget") == 0) {
+            budget = atof(argv[++i]) / 1000;
+        }
+        else if (strcmp(argv[i], "--policy") == 0) {
+            policy = argv[++i];
+        }
+    }
+    if (strcmp(policy, "random") == 0) {
+        config.policy = randomMove;
+    }
+    else if (strcmp(policy, "greedy") == 0) {
+        config.policy = greedyMove;
+    }
+    else if (strcmp(policy, "search") == 0) {
+        // The games already run on every core, so each search gets one thread
+        config.policy = [budget, &cache](const GameEngine& engine, Rng& rng, Move& move) {
+            SearchConfig search;
+            search.budget = budget;
+            search.threads = 1;
+            search.cache = &cache;
+            uint64_t high = rng.next();
+            search.seed = high << 32 | rng.next();
+            SearchResult result;
+            bool found = searchMove(engine, search, result);
+            move = result.move;
+            return found;
+        };
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    SimStats stats = simulate(config);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("games %ld, moves %ld in %.2f s: %.0f games/s, %.0f moves/s\n",
+        stats.games, stats.moves, seconds, stats.games / seconds, stats.moves / seconds);
+    if (stats.games == 0) {
+        return 0;
+    }
+    printf("score: mean %.1f, min %d, max %d\n", double(stats.totalScore) / stats.games, stats.minScore, stats.maxScore);
+    printf("bombs: dropped %ld, fired %ld; brushes: dropped %ld, fired %ld\n",
+        stats.bonuses.bombsDropped, stats.bonuses.bombsFired, stats.bonuses.brushesDropped, stats.bonuses.brushesFired);
+    if (cache.getLookups() > 0) {
+        printf("search cache: %ld lookups, %.2f%% hits\n", cache.getLookups(), 100 * cache.hitRate());
+    }
+    printHistogram("final score:", stats.scoreHistogram, SimStats::SCORE_BUCKET, stats.games);
+    printHistogram("cascade steps per move:", stats.cascadeHistogram, 1, stats.moves);
+}
@@ -0,0 +1,191 @@
+#include "simulator.h"
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+bool firstMove(const GameEngine& engine, Rng&, Move& move)
+{
+    return engine.hint(move);
+}
+
+bool randomMove(const GameEngine& engine, Rng& rng, Move& move)
+{
+    std::vector<Move> moves;
+    engine.findMoves(moves);
+    if (moves.empty()) {
+        return false;
+    }
+    move = moves[rng.below(int(moves.size()))];
+    return true;
+}
+
+bool greedyMove(const GameEngine& engine, Rng&, Move& move)
+{
+    std::vector<Move> moves;
+    engine.findMoves(moves);
+    int best = -1;
+    for (size_t i = 0; i < moves.size(); i++) {
+        // Play it on a copy, the bonus rolls see the same random numbers
+        GameEngine trial = engine;
+        trial.swap(moves[i].x1, moves[i].y1, moves[i].x2, moves[i].y2);
+        if (trial.getScore() > best) {
+            best = trial.getScore();
+            move = moves[i];
+        }
+    }
+    return best >= 0;
+}
+
+void SimStats::addGame(const GameEngine& engine)
+{
+    int score = engine.getScore();
+    minScore = games == 0 ? score : std::min(minScore, score);
+    maxScore = games == 0 ? score : std::max(maxScore, score);
+    games++;
+    totalScore += score;
+    size_t bucket = size_t(score / SCORE_BUCKET);
+    if (scoreHistogram.size() <= bucket) {
+        scoreHistogram.resize(bucket + 1);
+    }
+    scoreHistogram[bucket]++;
+
+    const BonusCounts& counts = engine.getBonusCounts();
+    bonuses.bombsFired += counts.bombsFired;
+    bonuses.brushesFired += counts.brushesFired;
+    bonuses.bombsDropped += counts.bombsDropped;
+    bonuses.brushesDropped += counts.brushesDropped;
+}
+
+void SimStats::addMove(const GameEngine& engine)
+{
+    moves++;
+    size_t length = size_t(engine.getCascade());
+    if (cascadeHistogram.size() <= length) {
+        cascadeHistogram.resize(length + 1);
+    }
+    cascadeHistogram[length]++;
+}
+
+void SimStats::merge(const SimStats& other)
+{
+    if (other.games == 0) {
+        return;
+    }
+    minScore = games == 0 ? other.minScore : std::min(minScore, other.minScore);
+    maxScore = games == 0 ? other.maxScore : std::max(maxScore, other.maxScore);
+    games += other.games;
+    moves += other.moves;
+    totalScore += other.totalScore;
+    if (scoreHistogram.size() < other.scoreHistogram.size()) {
+        scoreHistogram.resize(other.scoreHistogram.size());
+    }
+    for (size_t i = 0; i < other.scoreHistogram.size(); i++) {
+        scoreHistogram[i] += other.scoreHistogram[i];
+    }
+    if (cascadeHistogram.size() < other.cascadeHistogram.size()) {
+        cascadeHistogram.resize(other.cascadeHistogram.size());
+    }
+    for (size_t i = 0; i < other.cascadeHistogram.size(); i++) {
+        cascadeHistogram[i] += other.cascadeHistogram[i];
+    }
+    bonuses.bombsFired += other.bonuses.bombsFired;
+    bonuses.brushesFired += other.bonuses.brushesFired;
+    bonuses.bombsDropped += other.bonuses.bombsDropped;
+    bonuses.brushesDropped += other.bonuses.brushesDropped;
+}
+
+// Games [first, last)
+struct Chunk {
+    long first;
+    long last;
+};
+
+// Chunks of one thread. The owner takes them from the back, thieves from
+// the front, so they rarely meet.
+struct WorkQueue {
+    std::mutex lock;
+    std::deque<Chunk> chunks;
+};
+
+static const long CHUNK_GAMES = 16;
+
+static bool takeWork(std::vector<WorkQueue>& queues, int self, Chunk& chunk)
+{
+    {
+        std::lock_guard<std::mutex> guard(queues[self].lock);
+        if (!queues[self].chunks.empty()) {
+            chunk = queues[self].chunks.back();
+            queues[self].chunks.pop_back();
+            return true;
+        }
+    }
+    // No new work appears during a batch, so once every queue is empty the thread is done
+    int count = int(queues.size());
+    for (int i = 1; i < count; i++) {
+        WorkQueue& victim = queues[(self + i) % count];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.chunks.empty()) {
+            chunk = victim.chunks.front();
+            victim.chunks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+static void playGame(const SimConfig& config, long game, SimStats& stats)
+{
+    GameEngine engine{ Rng(config.seed + uint64_t(game)) };
+    engine.setBonusOdds(config.odds);
+    Rng policyRng(~(config.seed + uint64_t(game)));
+    for (int i = 0; i < config.movesPerGame; i++) {
+        Move move;
+        if (!config.policy(engine, policyRng, move)) {
+            break;
+        }
+        engine.swap(move.x1, move.y1, move.x2, move.y2);
+        stats.addMove(engine);
+    }
+    stats.addGame(engine);
+}
+
+SimStats simulate(const SimConfig& config)
+{
+    int threads = config.threads > 0 ? config.threads : int(std::max(1u, std::thread::hardware_concurrency()));
+
+    // Every thread starts with an equal run of consecutive chunks
+    std::vector<WorkQueue> queues(threads);
+    long chunks = (config.games + CHUNK_GAMES - 1) / CHUNK_GAMES;
+    for (long i = 0; i < chunks; i++) {
+        Chunk chunk = { i * CHUNK_GAMES, std::min(config.games, (i + 1) * CHUNK_GAMES) };
+        queues[i * threads / chunks].chunks.push_back(chunk);
+    }
+
+    std::vector<SimStats> results(threads);
+    auto work = [&](int self) {
+        // Accumulated locally, neighbouring results would share cache lines
+        SimStats stats;
+        Chunk chunk;
+        while (takeWork(queues, self, chunk)) {
+            for (long game = chunk.first; game < chunk.last; game++) {
+                playGame(config, game, stats);
+            }
+        }
+        results[self] = stats;
+    };
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; i++) {
+        pool.emplace_back(work, i);
+    }
+    work(0);
+    for (size_t i = 0; i < pool.size(); i++) {
+        pool[i].join();
+    }
+
+    SimStats total;
+    for (int i = 0; i < threads; i++) {
+        total.merge(results[i]);
+    }
+    return total;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "engine.h"
+
+// Chooses the next swap of a game, false ends the game early. The Rng is
+// the game's own stream for policies that pick at random.
+using MovePolicy = std::function<bool(const GameEngine& engine, Rng& rng, Move& move)>;
+
+bool firstMove(const GameEngine& engine, Rng& rng, Move& move); // the hint
+bool randomMove(const GameEngine& engine, Rng& rng, Move& move); // any matching swap
+bool greedyMove(const GameEngine& engine, Rng& rng, Move& move); // the swap that scores most right away
+
+struct SimConfig {
+    long games = 1000;
+    int movesPerGame = 100;
+    int threads = 0; // 0 for one per hardware thread
+    uint64_t seed = 1; // game i is played from seed + i
+    BonusOdds odds;
+    MovePolicy policy = firstMove;
+};
+
+// Totals of a batch of games. Every thread fills its own and they are
+// merged when the batch is done.
+struct SimStats {
+    static const int SCORE_BUCKET = 500; // points per bar of scoreHistogram
+
+    long games = 0;
+    long moves = 0;
+    long long totalScore = 0;
+    int minScore = 0;
+    int maxScore = 0;
+    std::vector<long> scoreHistogram; // final scores by SCORE_BUCKET
+    std::vector<long> cascadeHistogram; // moves by number of cascade steps
+    BonusCounts bonuses;
+
+    void addGame(const GameEngine& engine);
+    void addMove(const GameEngine& engine);
+    void merge(const SimStats& other);
+};
+
+// Play config.games independent games on a pool of threads that steal
+// chunks of games from each other when they run out
+SimStats simulate(const SimConfig& config);
@@ -0,0 +1,94 @@
+#include "snapshot.h"
+#include <cstdio>
+#include <cstring>
+
+static const uint8_t MAGIC[4] = { 'G', 'E', 'M', 'S' };
+
+bool validSnapshot(const Snapshot& in)
+{
+    if (in.width > BoardView::WIDTH || in.height > BoardView::HEIGHT || in.reserved[0] != 0
+        || in.reserved[1] != 0 || in.reserved[2] != 0 || in.reserved2 != 0) {
+        return false;
+    }
+    for (int y = 0; y < BoardView::HEIGHT; y++) {
+        for (int x = 0; x < BoardView::WIDTH; x++) {
+            uint8_t bits = in.board.cells[y][x].bits;
+            if (x >= in.width || y >= in.height) {
+                if (bits != 0) {
+                    return false;
+                }
+                continue;
+            }
+            // Low four bits: color plus one. High four bits: none, BOMB, or
+            // BRUSH with the brush color; the two bits between are unused.
+            int color = (bits & 0x0f) - 1;
+            uint8_t high = bits & 0xf0;
+            bool bonus = high == Cell::BOMB || (high & Cell::BRUSH && ((high >> 4) & 0x07) < in.colors);
+            if (color < 0 || color >= in.colors || (high != 0 && !bonus)) {
+                return false;
+            }
+        }
+    }
+    // Combinations are removed before a board is saved
+    auto color = [&](int x, int y) { return in.board.cells[y][x].color(); };
+    for (int y = 0; y < in.height; y++) {
+        for (int x = 0; x < in.width; x++) {
+            bool row = x + 2 < in.width && color(x + 1, y) == color(x, y) && color(x + 2, y) == color(x, y);
+            bool column = y + 2 < in.height && color(x, y + 1) == color(x, y) && color(x, y + 2) == color(x, y);
+            if (row || column) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool writeSnapshots(const std::string& path, const Snapshot* records, size_t count)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    uint8_t header[Snapshot::HEADER] = {};
+    memcpy(header, MAGIC, 4);
+    header[4] = Snapshot::VERSION;
+    uint32_t size = sizeof(Snapshot);
+    uint32_t total = uint32_t(count);
+    memcpy(header + 8, &size, 4);
+    memcpy(header + 12, &total, 4);
+    bool written = fwrite(header, 1, sizeof(header), file) == sizeof(header)
+        && fwrite(records, sizeof(Snapshot), count, file) == count;
+    return fclose(file) == 0 && written;
+}
+
+bool SnapshotFile::open(const std::string& path)
+{
+    close();
+    if (!mapping.open(path)) {
+        return false;
+    }
+    const uint8_t* bytes = mapping.data();
+    uint32_t size = 0;
+    uint32_t total = 0;
+    if (mapping.size() >= size_t(Snapshot::HEADER)) {
+        memcpy(&size, bytes + 8, 4);
+        memcpy(&total, bytes + 12, 4);
+    }
+    // A record size from another version would put every field elsewhere
+    if (mapping.size() < size_t(Snapshot::HEADER) || memcmp(bytes, MAGIC, 4) != 0
+        || bytes[4] != Snapshot::VERSION || size != sizeof(Snapshot)
+        || mapping.size() < Snapshot::HEADER + size_t(total) * sizeof(Snapshot)) {
+        close();
+        return false;
+    }
+    records = reinterpret_cast<const Snapshot*>(bytes + Snapshot::HEADER);
+    count = total;
+    return true;
+}
+
+void SnapshotFile::close()
+{
+    mapping.close();
+    records = nullptr;
+    count = 0;
+}
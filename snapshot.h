@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "engine.h"
+#include "mappedfile.h"
+
+// One saved game in 128 bytes: the settled board, the score, the bonus
+// odds and the position of the generator. Files keep records exactly as
+// they are in memory, in the byte order of the machine (little endian on
+// everything the game runs on), so a mapped file is used without parsing.
+//
+//   file: "GEMS", version, 3 zero bytes, record size (4 bytes),
+//         number of records (4 bytes), then the records
+struct Snapshot {
+    static const uint8_t VERSION = 1;
+    static const int HEADER = 16;
+
+    uint8_t width;
+    uint8_t height;
+    uint8_t colors;
+    uint8_t dropPercent;
+    uint8_t bombPercent;
+    uint8_t reserved[3];
+    int32_t score;
+    uint32_t reserved2;
+    uint64_t seed; // the game was created from this seed
+    uint64_t rng[4]; // xoshiro256** state
+    BoardView board; // cells beyond width x height are empty
+    uint64_t hash; // Zobrist hash of the board, checked on load
+};
+
+static_assert(sizeof(Snapshot) == 128, "snapshot records are 128 bytes");
+
+// False for boards larger than 8x8 and games on the mt19937 generator
+template <class Engine>
+bool saveSnapshot(const Engine& engine, Snapshot& out)
+{
+    const Rng& rng = engine.getRng();
+    if (engine.getWidth() > BoardView::WIDTH || engine.getHeight() > BoardView::HEIGHT
+        || rng.getKind() != Rng::Kind::XOSHIRO) {
+        return false;
+    }
+    out = Snapshot();
+    out.width = uint8_t(engine.getWidth());
+    out.height = uint8_t(engine.getHeight());
+    out.colors = uint8_t(engine.getColors());
+    out.dropPercent = uint8_t(engine.getBonusOdds().dropPercent);
+    out.bombPercent = uint8_t(engine.getBonusOdds().bombPercent);
+    out.score = engine.getScore();
+    out.seed = rng.getSeed();
+    rng.saveState(out.rng);
+    engine.view(out.board);
+    out.hash = engine.getHash();
+    return true;
+}
+
+// Every cell holds a gem of a color in play and no bonus, a bomb or a
+// brush of a color in play, no three gems in a row are alike, and nothing
+// is set outside the board or in the reserved fields: a settled board. A
+// damaged record fails this before it reaches an engine.
+bool validSnapshot(const Snapshot& in);
+
+// False when the engine has another size or number of colors, the record
+// is damaged, the board has no move or it does not match its hash. The
+// engine is only changed in the last two cases.
+template <class Engine>
+bool loadSnapshot(Engine& engine, const Snapshot& in)
+{
+    if (in.width != engine.getWidth() || in.height != engine.getHeight() || in.colors != engine.getColors()
+        || !validSnapshot(in)) {
+        return false;
+    }
+    Rng rng;
+    rng.restoreState(in.seed, in.rng);
+    if (!engine.load(in.board, in.score, rng)) {
+        return false;
+    }
+    BonusOdds odds;
+    odds.dropPercent = in.dropPercent;
+    odds.bombPercent = in.bombPercent;
+    engine.setBonusOdds(odds);
+    return engine.getHash() == in.hash;
+}
+
+bool writeSnapshots(const std::string& path, const Snapshot* records, size_t count);
+
+// Records of a snapshot file, read straight from the mapping. Pages are
+// only loaded when a record on them is used.
+class SnapshotFile {
+public:
+    bool open(const std::string& path); // false for a missing file or a bad header
+    void close();
+    size_t size() const { return count; }
+    const Snapshot& operator[](size_t i) const { return records[i]; }
+
+private:
+    MappedFile mapping;
+    const Snapshot* records = nullptr;
+    size_t count = 0;
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Bounded queue from one producer thread to one consumer thread without
+// locks. CAPACITY must be a power of two.
+template <class Value, size_t CAPACITY>
+class SpscQueue {
+public:
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+    SpscQueue()
+        : head(0)
+        , tail(0)
+    {
+    }
+
+    // Producer: false when the queue is full
+    bool push(const Value& value)
+    {
+        size_t end = tail.load(std::memory_order_relaxed);
+        if (end - head.load(std::memory_order_acquire) == CAPACITY) {
+            return false;
+        }
+        items[end & (CAPACITY - 1)] = value;
+        tail.store(end + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: false when the queue is empty
+    bool pop(Value& value)
+    {
+        size_t start = head.load(std::memory_order_relaxed);
+        if (start == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = items[start & (CAPACITY - 1)];
+        head.store(start + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    Value items[CAPACITY];
+    alignas(64) std::atomic<size_t> head; // next item to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tail; // next free item, written by the producer
+};
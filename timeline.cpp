@@ -0,0 +1,77 @@
+#include "timeline.h"
+#include <algorithm>
+
+Timeline::Timeline()
+    : first(0)
+    , queued(0)
+    , elapsed(0)
+    , board()
+    , score(0)
+{
+}
+
+void Timeline::reset(const BoardView& view, int points)
+{
+    first = 0;
+    queued = 0;
+    elapsed = 0;
+    board = view;
+    score = points;
+}
+
+void Timeline::reserve(size_t count, size_t cells)
+{
+    if (entries.size() < count) {
+        std::rotate(entries.begin(), entries.begin() + first, entries.end());
+        first = 0;
+        entries.resize(count);
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i].step.cells.reserve(cells);
+    }
+}
+
+Step& Timeline::push(const Step& step, float duration)
+{
+    if (queued == entries.size()) {
+        // Full: unroll the ring so the new slot goes after the last step
+        std::rotate(entries.begin(), entries.begin() + first, entries.end());
+        first = 0;
+        entries.emplace_back();
+    }
+    Entry& entry = entries[(first + queued) % entries.size()];
+    entry.step = step; // the cell list keeps its capacity
+    entry.duration = duration;
+    queued++;
+    return entry.step;
+}
+
+void Timeline::advance(float seconds)
+{
+    elapsed += seconds;
+    // A long frame may finish several short steps at once
+    while (queued > 0 && elapsed >= entries[first].duration) {
+        const Entry& entry = entries[first];
+        elapsed -= entry.duration;
+        board = entry.step.board;
+        score = entry.step.score;
+        first = (first + 1) % entries.size();
+        queued--;
+    }
+    if (queued == 0) {
+        elapsed = 0;
+    }
+}
+
+float Timeline::progress() const
+{
+    if (queued == 0 || entries[first].duration <= 0) {
+        return 1;
+    }
+    return elapsed / entries[first].duration;
+}
+
+int Timeline::getScore() const
+{
+    return queued == 0 ? score : entries[first].step.score;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include "engine.h"
+
+// Plays the steps of resolved moves one after another. It is advanced by
+// the frame clock and never blocks, the renderer asks it what to show.
+// Played steps leave their memory to the ones pushed later, so after
+// reserve showing a move does not allocate.
+class Timeline {
+public:
+    Timeline();
+    void reset(const BoardView& board, int points); // show a settled board, drop queued steps
+    void reserve(size_t count, size_t cells); // queued steps of up to cells cells each
+    Step& push(const Step& step, float duration); // the queued copy
+    void advance(float seconds);
+
+    bool isBusy() const { return queued > 0; }
+    const Step* current() const { return queued == 0 ? nullptr : &entries[first].step; }
+    float progress() const; // how far the current step has played, from 0 to 1
+    const BoardView& settled() const { return board; } // board before the current step
+    int getScore() const; // score to display right now
+private:
+    struct Entry {
+        Step step;
+        float duration; // seconds
+    };
+    std::vector<Entry> entries; // ring of queued steps starting at first
+    size_t first;
+    size_t queued;
+    float elapsed; // time spent in the current step
+    BoardView board;
+    int score;
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Fixed-size cache from 64-bit board hashes to values, shared by threads.
+// The slots are split into SHARDS groups with a lock each, so threads
+// rarely wait for each other. A new entry replaces whatever held its slot.
+template <class Value>
+class TranspositionTable {
+public:
+    static const int SHARDS = 64;
+
+    // entries is rounded up to a power of two
+    explicit TranspositionTable(size_t entries = size_t(1) << 16)
+        : lookups(0)
+        , hits(0)
+    {
+        size_t size = SHARDS;
+        while (size < entries) {
+            size *= 2;
+        }
+        slots.resize(size);
+    }
+
+    bool find(uint64_t key, Value& value)
+    {
+        lookups.fetch_add(1, std::memory_order_relaxed);
+        size_t slot = key & (slots.size() - 1);
+        std::lock_guard<std::mutex> guard(shards[slot % SHARDS]);
+        if (!slots[slot].used || slots[slot].key != key) {
+            return false;
+        }
+        value = slots[slot].value;
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void store(uint64_t key, const Value& value)
+    {
+        size_t slot = key & (slots.size() - 1);
+        std::lock_guard<std::mutex> guard(shards[slot % SHARDS]);
+        slots[slot].key = key;
+        slots[slot].used = true;
+        slots[slot].value = value;
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < slots.size(); i++) {
+            std::lock_guard<std::mutex> guard(shards[i % SHARDS]);
+            slots[i].used = false;
+        }
+        lookups = 0;
+        hits = 0;
+    }
+
+    long getLookups() const { return lookups.load(); }
+    long getHits() const { return hits.load(); }
+    double hitRate() const { return lookups ? double(hits) / lookups : 0; }
+
+private:
+    struct Slot {
+        uint64_t key = 0;
+        bool used = false;
+        Value value = Value();
+    };
+
+    std::vector<Slot> slots;
+    std::mutex shards[SHARDS];
+    std::atomic<long> lookups;
+    std::atomic<long> hits;
+};
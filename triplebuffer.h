@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Hands the latest value from one writer thread to one reader thread
+// without locks. The writer fills its back slot and trades it for the
+// middle one, the reader trades its front slot for the middle one when a
+// newer value is there. Neither side ever waits, the reader always sees a
+// whole value and values it was too slow for are skipped.
+template <class Value>
+class TripleBuffer {
+public:
+    TripleBuffer()
+        : middle(1)
+        , back(2)
+        , front(0)
+    {
+    }
+
+    // Writer: the slot to fill completely, it holds an old value
+    Value& writeSlot() { return slots[back]; }
+
+    // Writer: make the filled slot the latest value
+    void publish()
+    {
+        back = middle.exchange(uint8_t(back | FRESH), std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Reader: has a value been published since the last read?
+    bool hasNew() const { return (middle.load(std::memory_order_acquire) & FRESH) != 0; }
+
+    // Reader: the latest value, valid until the next read
+    const Value& read()
+    {
+        if (hasNew()) {
+            front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        }
+        return slots[front];
+    }
+
+private:
+    static const uint8_t INDEX = 3;
+    static const uint8_t FRESH = 4;
+
+    Value slots[3];
+    std::atomic<uint8_t> middle; // index of the middle slot, FRESH until the reader takes it
+    uint8_t back; // owned by the writer
+    uint8_t front; // owned by the reader
+};